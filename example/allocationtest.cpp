@@ -0,0 +1,121 @@
+//
+//  allocationtest.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include "ratatoskr.h"
+
+#include "allocationtest.h"
+
+#define ALLOCATION_TEST_ROUNDS 400
+#define ALLOCATION_TEST_MESSAGES 250 // Three messages each, so a round fits into the default queue of 1024 messages
+
+// Only allocations of the thread running the test are counted, and only while it asks for it
+static thread_local bool allocation_counting = false;
+static thread_local size_t allocation_count = 0;
+
+void *operator new(size_t size)
+{
+	if(allocation_counting)
+		allocation_count ++;
+	
+	void *result = std::malloc(size ? size : 1);
+	if(!result)
+		throw std::bad_alloc();
+	
+	return result;
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+namespace allocation_test
+{
+	class render_engine : public ratatoskr::logging_engine
+	{
+	public:
+		bool is_good() const override { return true; }
+		void flush() override {}
+		void finalize() override {}
+		
+		void write(const ratatoskr::message& message) override
+		{
+			_buffer.clear();
+			message.render(_buffer);
+		}
+		
+	private:
+		ratatoskr::small_buffer<256> _buffer;
+	};
+	
+	void log_messages(ratatoskr::logger& logger, const std::string& text, size_t count)
+	{
+		for(size_t i = 0; i < count; i ++)
+		{
+			{
+				ratatoskr::loggable loggable(logger);
+				loggable << "result " << i << " " << 3.25 << " " << static_cast<const void *>(&text) << " " << text << std::hex << 255;
+			}
+			
+			{
+				ratatoskr::loggable loggable(logger, ratatoskr::log_level::info, ratatoskr::format_mode::deferred);
+				loggable << "deferred " << i << " " << text;
+			}
+			
+			rklog_to(logger, info, "format {} {}", i, text);
+		}
+	}
+	
+	void run_test()
+	{
+		render_engine engine;
+		ratatoskr::logger logger;
+		logger.add_logging_engine(&engine);
+		
+		std::string text("a std::string argument");
+		
+		// Producer queues and formatter state are set up lazily by the first messages
+		log_messages(logger, text, ALLOCATION_TEST_MESSAGES);
+		logger.flush(true);
+		
+		size_t allocations = 0;
+		
+		for(size_t i = 0; i < ALLOCATION_TEST_ROUNDS; i ++)
+		{
+			allocation_count = 0;
+			allocation_counting = true;
+			
+			log_messages(logger, text, ALLOCATION_TEST_MESSAGES);
+			
+			allocation_counting = false;
+			allocations += allocation_count;
+			
+			// Keeps the queue from spilling into the overflow buffer
+			logger.flush(true);
+		}
+		
+		logger.remove_logging_engine(&engine);
+		
+		std::cout << "allocations: " << (ALLOCATION_TEST_ROUNDS * ALLOCATION_TEST_MESSAGES * 3) << " messages, " << allocations << " allocations" << std::endl;
+		
+		if(allocations > 0)
+		{
+			std::cerr << "Logging allocated memory after warm-up" << std::endl;
+			std::abort();
+		}
+	}
+}
@@ -0,0 +1,18 @@
+//
+//  allocationtest.h
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#ifndef __ratatoskr__allocationtest__
+#define __ratatoskr__allocationtest__
+
+namespace allocation_test
+{
+	// Aborts if logging allocates on the calling thread once the logger is warmed up
+	void run_test();
+}
+
+#endif /* defined(__ratatoskr__allocationtest__) */
@@ -0,0 +1,348 @@
+//
+//  benchmark.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "ratatoskr.h"
+
+#include "benchmark.h"
+
+#define BENCHMARK_MESSAGES (256 * 1024)
+#define BENCHMARK_PATH "ratatoskr_benchmark.log"
+
+// Filtered calls are made at debug level, which the engines don't accept
+#define BENCHMARK_LOG(target, filtered, format, ...) \
+	do { \
+		if(filtered) \
+			rklog_to(target, debug, format, ##__VA_ARGS__); \
+		else \
+			rklog_to(target, info, format, ##__VA_ARGS__); \
+	} while(0)
+
+namespace benchmark
+{
+	enum class engine_type
+	{
+		null,
+		file,
+		cout
+	};
+	
+	enum class argument_type
+	{
+		string,
+		integers,
+		floating_point,
+		mixed,
+		loggable
+	};
+	
+	// Every case varies one parameter of the baseline
+	struct parameters
+	{
+		const char *sweep;
+		engine_type engine;
+		size_t threads;
+		size_t payload; // Length of the string argument
+		argument_type arguments;
+		size_t filtered; // Out of 10 calls
+		size_t messages;
+	};
+	
+	struct results
+	{
+		double seconds; // Until the last message was written
+		double submit_seconds; // Until the last thread was done logging
+		ratatoskr::histogram call_time; // Nanoseconds per call
+		ratatoskr::logger_telemetry telemetry;
+	};
+	
+	// Discards everything, but still asks for the text so the rendering isn't skipped
+	class null_engine : public ratatoskr::logging_engine
+	{
+	public:
+		null_engine() :
+			_bytes(0)
+		{}
+		
+		bool is_good() const override { return true; }
+		void flush() override {}
+		void finalize() override {}
+		
+		void write(const ratatoskr::message& message) override
+		{
+			_bytes += message.get_length();
+		}
+		
+		void write_batch(const ratatoskr::message_batch& batch) override
+		{
+			for(auto& message : batch)
+				_bytes += message.get_length();
+		}
+		
+	private:
+		size_t _bytes;
+	};
+	
+	const char *get_name(engine_type engine)
+	{
+		switch(engine)
+		{
+			case engine_type::null:
+				return "null";
+			case engine_type::file:
+				return "file";
+			case engine_type::cout:
+				return "cout";
+		}
+		
+		return "unknown";
+	}
+	
+	const char *get_name(argument_type arguments)
+	{
+		switch(arguments)
+		{
+			case argument_type::string:
+				return "string";
+			case argument_type::integers:
+				return "integers";
+			case argument_type::floating_point:
+				return "floating_point";
+			case argument_type::mixed:
+				return "mixed";
+			case argument_type::loggable:
+				return "loggable";
+		}
+		
+		return "unknown";
+	}
+	
+	void log_message(ratatoskr::logger& logger, argument_type arguments, bool filtered, size_t thread, size_t index, const std::string& payload)
+	{
+		switch(arguments)
+		{
+			case argument_type::string:
+				BENCHMARK_LOG(logger, filtered, "benchmark message {}", payload);
+				break;
+			case argument_type::integers:
+				BENCHMARK_LOG(logger, filtered, "benchmark thread {} message {} of {} {}", thread, index, -static_cast<long>(index), payload);
+				break;
+			case argument_type::floating_point:
+				BENCHMARK_LOG(logger, filtered, "benchmark {} took {}ms at {} {}", index * 0.5, 3.14159, 1e-3, payload);
+				break;
+			case argument_type::mixed:
+				BENCHMARK_LOG(logger, filtered, "benchmark thread {} message {} took {}ms in {} {}", thread, index, index * 0.25, "stage", payload);
+				break;
+			case argument_type::loggable:
+				ratatoskr::loggable(logger, filtered ? ratatoskr::log_level::debug : ratatoskr::log_level::info) << "benchmark thread " << thread << " message " << index << " " << payload;
+				break;
+		}
+	}
+	
+	results run_case(const parameters& parameters)
+	{
+		std::unique_ptr<ratatoskr::logging_engine> engine;
+		
+		switch(parameters.engine)
+		{
+			case engine_type::null:
+				engine.reset(new null_engine());
+				break;
+			case engine_type::file:
+				engine.reset(new ratatoskr::file_logging_engine(BENCHMARK_PATH));
+				break;
+			case engine_type::cout:
+				engine.reset(new ratatoskr::stream_logging_engine(std::cout));
+				break;
+		}
+		
+		ratatoskr::logger logger;
+		logger.add_logging_engine(engine.get());
+		
+		std::string payload(parameters.payload, 'x');
+		std::vector<ratatoskr::histogram> call_times(parameters.threads);
+		std::vector<std::thread> threads;
+		std::atomic<size_t> ready(0);
+		std::atomic<bool> start(false);
+		
+		size_t count = parameters.messages / parameters.threads;
+		
+		for(size_t i = 0; i < parameters.threads; i ++)
+		{
+			threads.emplace_back([&, i] {
+				
+				ratatoskr::histogram& call_time = call_times[i];
+				
+				ready ++;
+				
+				while(!start.load())
+					std::this_thread::yield();
+				
+				for(size_t j = 0; j < count; j ++)
+				{
+					bool filtered = ((j % 10) < parameters.filtered);
+					
+					uint64_t begin = ratatoskr::timekeeper::stamp(ratatoskr::clock_source::cycle_counter);
+					log_message(logger, parameters.arguments, filtered, i, j, payload);
+					uint64_t end = ratatoskr::timekeeper::stamp(ratatoskr::clock_source::cycle_counter);
+					
+					call_time.record(end - begin);
+				}
+			});
+		}
+		
+		while(ready.load() < parameters.threads)
+			std::this_thread::yield();
+		
+		// The cycle counter gets converted with the rate measured over the whole run
+		auto begin = std::chrono::steady_clock::now();
+		uint64_t begin_cycles = ratatoskr::timekeeper::stamp(ratatoskr::clock_source::cycle_counter);
+		
+		start.store(true);
+		
+		for(auto& thread : threads)
+			thread.join();
+		
+		auto submitted = std::chrono::steady_clock::now();
+		uint64_t end_cycles = ratatoskr::timekeeper::stamp(ratatoskr::clock_source::cycle_counter);
+		
+		logger.flush(true);
+		logger.remove_logging_engine(engine.get());
+		
+		auto end = std::chrono::steady_clock::now();
+		
+		results results;
+		results.seconds = std::chrono::duration<double>(end - begin).count();
+		results.submit_seconds = std::chrono::duration<double>(submitted - begin).count();
+		results.telemetry = logger.get_telemetry();
+		
+		double ns_per_cycle = std::chrono::duration<double, std::nano>(submitted - begin).count() / std::max<double>(static_cast<double>(end_cycles - begin_cycles), 1.0);
+		
+		ratatoskr::histogram cycles;
+		
+		for(auto& call_time : call_times)
+			cycles.merge(call_time);
+		
+		// Buckets are converted at their upper limit, which is what the percentiles report anyway
+		for(size_t i = 0; i < ratatoskr::histogram::bucket_count; i ++)
+		{
+			uint64_t count = cycles.get_bucket_count(i);
+			
+			if(count > 0)
+				results.call_time.record(static_cast<uint64_t>(std::min(ratatoskr::histogram::get_bucket_limit(i), cycles.get_max()) * ns_per_cycle), count);
+		}
+		
+		std::remove(BENCHMARK_PATH);
+		return results;
+	}
+	
+	void write_results(std::ostream& stream, const parameters& parameters, const results& results)
+	{
+		size_t messages = (parameters.messages / parameters.threads) * parameters.threads;
+		const ratatoskr::histogram& call_time = results.call_time;
+		
+		stream << "{\"sweep\":\"" << parameters.sweep << "\",\"engine\":\"" << get_name(parameters.engine) << "\",\"threads\":" << parameters.threads;
+		stream << ",\"payload\":" << parameters.payload << ",\"arguments\":\"" << get_name(parameters.arguments) << "\",\"filtered\":" << (parameters.filtered / 10.0);
+		stream << ",\"messages\":" << messages << ",\"seconds\":" << results.seconds;
+		stream << ",\"throughput\":" << (messages / results.seconds) << ",\"submit_throughput\":" << (messages / results.submit_seconds);
+		stream << ",\"call_ns\":{\"p50\":" << call_time.get_percentile(50.0) << ",\"p90\":" << call_time.get_percentile(90.0) << ",\"p99\":" << call_time.get_percentile(99.0);
+		stream << ",\"p999\":" << call_time.get_percentile(99.9) << ",\"max\":" << call_time.get_max() << "}";
+		stream << ",\"delivery_p99_us\":" << (results.telemetry.latency.get_percentile(99.0) / 1000) << ",\"dropped\":" << results.telemetry.dropped;
+		stream << ",\"overflowed\":" << results.telemetry.overflowed << "}" << std::endl;
+	}
+	
+	// Goes to stderr, stdout belongs to the cout engine
+	void print_results(const parameters& parameters, const results& results)
+	{
+		size_t messages = (parameters.messages / parameters.threads) * parameters.threads;
+		const ratatoskr::histogram& call_time = results.call_time;
+		
+		std::cerr << parameters.sweep << ": " << get_name(parameters.engine) << " engine, " << parameters.threads << " threads, " << parameters.payload << " byte payload, ";
+		std::cerr << get_name(parameters.arguments) << " arguments, " << (parameters.filtered * 10) << "% filtered: ";
+		std::cerr << static_cast<long>(messages / results.seconds) << " messages/s, per call p50 " << call_time.get_percentile(50.0) << "ns, p99 " << call_time.get_percentile(99.0) << "ns, max " << call_time.get_max() << "ns" << std::endl;
+	}
+	
+	void run_test(const char *path)
+	{
+		size_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+		
+		const parameters baseline = { "baseline", engine_type::null, std::min<size_t>(hardware, 4), 64, argument_type::mixed, 0, BENCHMARK_MESSAGES };
+		std::vector<parameters> cases = { baseline };
+		
+		std::vector<size_t> thread_counts = { 1, 2, 4, 8, hardware };
+		std::sort(thread_counts.begin(), thread_counts.end());
+		thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+		
+		for(size_t threads : thread_counts)
+		{
+			if(threads != baseline.threads && threads <= hardware * 2)
+			{
+				parameters variant = baseline;
+				variant.sweep = "threads";
+				variant.threads = threads;
+				cases.push_back(variant);
+			}
+		}
+		
+		for(size_t payload : { 8, 512 })
+		{
+			parameters variant = baseline;
+			variant.sweep = "payload";
+			variant.payload = payload;
+			cases.push_back(variant);
+		}
+		
+		for(argument_type arguments : { argument_type::string, argument_type::integers, argument_type::floating_point, argument_type::loggable })
+		{
+			parameters variant = baseline;
+			variant.sweep = "arguments";
+			variant.arguments = arguments;
+			cases.push_back(variant);
+		}
+		
+		for(size_t filtered : { 5, 9 })
+		{
+			parameters variant = baseline;
+			variant.sweep = "filtered";
+			variant.filtered = filtered;
+			cases.push_back(variant);
+		}
+		
+		for(engine_type engine : { engine_type::file, engine_type::cout })
+		{
+			parameters variant = baseline;
+			variant.sweep = "engine";
+			variant.engine = engine;
+			
+			// Keeps the terminal usable
+			if(engine == engine_type::cout)
+				variant.messages = BENCHMARK_MESSAGES / 16;
+			
+			cases.push_back(variant);
+		}
+		
+		std::ofstream output(path, std::ios::out | std::ios::trunc);
+		
+		for(auto& parameters : cases)
+		{
+			results results = run_case(parameters);
+			
+			print_results(parameters, results);
+			write_results(output, parameters, results);
+		}
+		
+		std::cerr << "Wrote " << cases.size() << " results to " << path << std::endl;
+	}
+}
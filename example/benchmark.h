@@ -0,0 +1,18 @@
+//
+//  benchmark.h
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#ifndef __ratatoskr__benchmark__
+#define __ratatoskr__benchmark__
+
+namespace benchmark
+{
+	// Prints a summary of every case and writes the results as one JSON object per line, so runs can be diffed
+	void run_test(const char *results = "ratatoskr_benchmark.json");
+}
+
+#endif /* defined(__ratatoskr__benchmark__) */
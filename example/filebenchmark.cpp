@@ -0,0 +1,173 @@
+//
+//  filebenchmark.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include "ratatoskr.h"
+
+#include "filebenchmark.h"
+#include "timer.h"
+
+#define FILE_BENCHMARK_MESSAGES (1024 * 1024)
+#define FILE_BENCHMARK_PATH "ratatoskr_benchmark.log"
+
+namespace file_benchmark
+{
+	// Forwards to another engine and measures how long the flush thread spends in it per batch
+	class timed_engine : public ratatoskr::logging_engine
+	{
+	public:
+		timed_engine(ratatoskr::logging_engine *engine) :
+			_engine(engine),
+			_batch(0),
+			_batches(0),
+			_total(0),
+			_max(0)
+		{
+			set_log_level(engine->get_log_level());
+		}
+		
+		bool is_good() const override { return _engine->is_good(); }
+		void finalize() override { _engine->finalize(); }
+		
+		void write(const ratatoskr::message& message) override
+		{
+			auto start = std::chrono::steady_clock::now();
+			_engine->write(message);
+			_batch += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+		
+		// Forwards the whole batch, so the engine formats it the way it would without the wrapper and the
+		// clock is read once per batch instead of twice per message
+		void write_batch(const ratatoskr::message_batch& batch) override
+		{
+			auto start = std::chrono::steady_clock::now();
+			_engine->write_batch(batch);
+			_batch += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+		
+		void flush() override
+		{
+			auto start = std::chrono::steady_clock::now();
+			_engine->flush();
+			_batch += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			
+			_total += _batch;
+			_max = std::max(_max, _batch);
+			_batches ++;
+			_batch = 0;
+		}
+		
+		double get_average() const { return (_batches > 0) ? (_total / 1000.0 / _batches) : 0.0; }
+		double get_max() const { return _max / 1000.0; }
+		
+	private:
+		ratatoskr::logging_engine *_engine;
+		
+		long long _batch;
+		long long _batches;
+		long long _total;
+		long long _max;
+	};
+	
+	void benchmark_thread(size_t thread, size_t count)
+	{
+		for(size_t i = 0; i < count; i ++)
+		{
+			rkinfof("benchmark thread {} wrote message {} of {}, padding it out to a typical log line length", thread, i, count);
+		}
+	}
+	
+	template<class T>
+	void run_engine(const char *name)
+	{
+		ratatoskr::logger *logger = ratatoskr::logger::get_shared_instance();
+		
+		T engine(FILE_BENCHMARK_PATH);
+		timed_engine timed(&engine);
+		
+		logger->flush(true);
+		logger->add_logging_engine(&timed);
+		
+		std::vector<std::thread> threads;
+		size_t count = std::max(std::thread::hardware_concurrency(), 1u);
+		
+		timer timer;
+		
+		for(size_t i = 0; i < count; i ++)
+		{
+			threads.emplace_back(std::thread(std::bind(&benchmark_thread, i, FILE_BENCHMARK_MESSAGES / count)));
+		}
+		
+		for(auto& thread : threads)
+		{
+			thread.join();
+		}
+		
+		logger->flush(true);
+		logger->remove_logging_engine(&timed);
+		
+		long time = std::max(timer.time(), 1L);
+		double megabytes = engine.get_bytes_written() / (1024.0 * 1024.0);
+		
+		std::cout << name << ": wrote " << megabytes << " MB in " << time << " milliseconds, " << (megabytes * 1000.0 / time) << " MB/s, ";
+		std::cout << "flush thread spent " << timed.get_average() << "us per batch on average, " << timed.get_max() << "us at most" << std::endl;
+		
+		std::remove(FILE_BENCHMARK_PATH);
+	}
+	
+	
+	void run_test()
+	{
+		run_engine<ratatoskr::file_logging_engine>("file_logging_engine");
+		run_engine<ratatoskr::async_file_logging_engine>("async_file_logging_engine");
+	}
+	
+	void run_compression_test()
+	{
+		typedef ratatoskr::compressed_logging_engine::codec codec;
+		
+		codec compression = ratatoskr::compressed_logging_engine::get_default_codec();
+		const char *path = (compression == codec::zstd) ? "ratatoskr_benchmark.log.zst" : ((compression == codec::lz4) ? "ratatoskr_benchmark.log.lz4" : "ratatoskr_benchmark.log");
+		
+		ratatoskr::logger *logger = ratatoskr::logger::get_shared_instance();
+		ratatoskr::compressed_logging_engine engine(path, compression);
+		
+		logger->flush(true);
+		logger->add_logging_engine(&engine);
+		
+		std::vector<std::thread> threads;
+		size_t count = std::max(std::thread::hardware_concurrency(), 1u);
+		
+		timer timer;
+		
+		for(size_t i = 0; i < count; i ++)
+		{
+			threads.emplace_back(std::thread(std::bind(&benchmark_thread, i, FILE_BENCHMARK_MESSAGES / count)));
+		}
+		
+		for(auto& thread : threads)
+		{
+			thread.join();
+		}
+		
+		logger->flush(true);
+		logger->remove_logging_engine(&engine); // Waits for the compression thread
+		
+		long time = std::max(timer.time(), 1L);
+		double megabytes = engine.get_bytes_in() / (1024.0 * 1024.0);
+		double ratio = (engine.get_bytes_out() > 0) ? (static_cast<double>(engine.get_bytes_in()) / engine.get_bytes_out()) : 0.0;
+		
+		std::cout << "Compressed " << megabytes << " MB into " << path << " in " << time << " milliseconds, " << (megabytes * 1000.0 / time) << " MB/s, ratio " << ratio << std::endl;
+		
+		std::remove(path);
+	}
+}
@@ -0,0 +1,18 @@
+//
+//  filebenchmark.h
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#ifndef __ratatoskr__filebenchmark__
+#define __ratatoskr__filebenchmark__
+
+namespace file_benchmark
+{
+	void run_test();
+	void run_compression_test();
+}
+
+#endif /* defined(__ratatoskr__filebenchmark__) */
@@ -0,0 +1,94 @@
+//
+//  lockbenchmark.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <ctime>
+#include "ratatoskr.h"
+
+#include "lockbenchmark.h"
+#include "timer.h"
+
+#define LOCK_BENCHMARK_ITERATIONS (8 * 1024 * 1024)
+
+namespace lock_benchmark
+{
+	// Roughly what the logger does under its locks, append to a shared buffer
+	struct shared_state
+	{
+		std::vector<size_t> buffer;
+	};
+	
+	template<class T>
+	void benchmark_thread(T *lock, shared_state *state, size_t count)
+	{
+		size_t local = 0;
+		
+		for(size_t i = 0; i < count; i ++)
+		{
+			{
+				std::lock_guard<T> guard(*lock);
+				
+				if(state->buffer.size() >= 1024)
+					state->buffer.clear();
+				
+				state->buffer.push_back(i);
+			}
+			
+			// Some work outside of the lock, like formatting the next message
+			for(size_t j = 0; j < 64; j ++)
+				local += j * i;
+		}
+		
+		volatile size_t sink = local;
+		(void)sink;
+	}
+	
+	template<class T>
+	void run_lock(const char *name, size_t oversubscription)
+	{
+		T lock;
+		shared_state state;
+		
+		std::vector<std::thread> threads;
+		size_t count = std::max(std::thread::hardware_concurrency(), 1u) * oversubscription;
+		
+		timer timer;
+		std::clock_t cpu = std::clock();
+		
+		for(size_t i = 0; i < count; i ++)
+		{
+			threads.emplace_back(std::thread(std::bind(&benchmark_thread<T>, &lock, &state, LOCK_BENCHMARK_ITERATIONS / count)));
+		}
+		
+		for(auto& thread : threads)
+		{
+			thread.join();
+		}
+		
+		long time = std::max(timer.time(), 1L);
+		double cpu_time = static_cast<double>(std::clock() - cpu) * 1000.0 / CLOCKS_PER_SEC;
+		
+		std::cout << name << " with " << count << " threads (" << oversubscription << "x cores): " << time << " milliseconds, ";
+		std::cout << (LOCK_BENCHMARK_ITERATIONS / 1000.0 / time) << "M locks/s, " << static_cast<long>(cpu_time) << " milliseconds of CPU time" << std::endl;
+	}
+	
+	
+	void run_test()
+	{
+		for(size_t oversubscription : { 1, 2, 4 })
+		{
+			run_lock<ratatoskr::spinlock>("spinlock", oversubscription);
+			run_lock<ratatoskr::adaptive_lock>("adaptive_lock", oversubscription);
+			run_lock<std::mutex>("std::mutex", oversubscription);
+		}
+	}
+}
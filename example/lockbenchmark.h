@@ -0,0 +1,17 @@
+//
+//  lockbenchmark.h
+//  ratatoskr
+//
+//  Created by Sidney Just on 15.11.13.
+//  Copyright (c) 2013 Sidney Just. All rights reserved.
+//
+
+#ifndef __ratatoskr__lockbenchmark__
+#define __ratatoskr__lockbenchmark__
+
+namespace lock_benchmark
+{
+	void run_test();
+}
+
+#endif /* defined(__ratatoskr__lockbenchmark__) */
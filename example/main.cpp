@@ -7,12 +7,30 @@
 //
 
 #include "ratatoskr.h"
-#include "stresstest.h"
+#include "allocationtest.h"
+#include "benchmark.h"
+#include "filebenchmark.h"
+#include "lockbenchmark.h"
 
 int main(int argc, const char * argv[])
 {
 	rkdebug("Hello World");
-	stress_test::run_test();
+	
+	// Format strings are checked at compile time, this one is well past the constexpr recursion limit of 512
+	rkinfof("A long format string with {} placeholders. Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+			"sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud "
+			"exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit "
+			"in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non "
+			"proident, sunt in culpa qui officia deserunt mollit anim id est laborum. Sed ut perspiciatis unde "
+			"omnis iste natus error sit voluptatem accusantium doloremque laudantium, totam rem aperiam, eaque ipsa quae ab "
+			"illo inventore veritatis et quasi architecto beatae vitae dicta sunt explicabo. {{Escaped braces}} work as well, "
+			"and so does a placeholder at the very end, which makes this {} characters long: {}", 3, 827, "done");
+	
+	allocation_test::run_test();
+	benchmark::run_test();
+	file_benchmark::run_test();
+	file_benchmark::run_compression_test();
+	lock_benchmark::run_test();
 	
     return 0;
 }
@@ -1,17 +0,0 @@
-//
-//  stresstest.h
-//  ratatoskr
-//
-//  Created by Sidney Just on 15.11.13.
-//  Copyright (c) 2013 Sidney Just. All rights reserved.
-//
-
-#ifndef __ratatoskr__stresstest__
-#define __ratatoskr__stresstest__
-
-namespace stress_test
-{
-	void run_test();
-}
-
-#endif /* defined(__ratatoskr__stresstest__) */
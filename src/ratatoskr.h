@@ -22,5 +22,12 @@
 #include "rklogger.h"
 #include "rkloggable.h"
 #include "rkloggingengine.h"
+#include "rkfileloggingengine.h"
+#include "rkmmaploggingengine.h"
+#include "rkasyncfileloggingengine.h"
+#include "rkcompressedloggingengine.h"
+#include "rkstructuredloggingengine.h"
+#include "rkshardedlogger.h"
+#include "rkcrashhandler.h"
 
 #endif /* _RATATOSKR_RATATOSKR_H_ */
@@ -0,0 +1,115 @@
+//
+//  rkarena.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_ARENA_H_
+#define _RATATOSKR_ARENA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace ratatoskr
+{
+	// Bump allocator that hands out memory from large chunks. Nothing is freed individually,
+	// reset() releases everything at once but keeps the chunks around for reuse.
+	class arena
+	{
+	public:
+		arena(size_t chunk_size = 64 * 1024) :
+			_chunk_size(chunk_size),
+			_chunk(0),
+			_offset(0)
+		{}
+		
+		~arena()
+		{
+			for(auto& chunk : _chunks)
+				std::free(chunk.data);
+		}
+		
+		arena(const arena&) = delete;
+		arena& operator= (const arena&) = delete;
+		
+		char *allocate(size_t size)
+		{
+			while(_chunk < _chunks.size())
+			{
+				chunk& current = _chunks[_chunk];
+				
+				if(current.size - _offset >= size)
+				{
+					char *data = current.data + _offset;
+					_offset += size;
+					
+					return data;
+				}
+				
+				_chunk ++;
+				_offset = 0;
+			}
+			
+			chunk chunk;
+			chunk.size = (size > _chunk_size) ? size : _chunk_size;
+			chunk.data = static_cast<char *>(std::malloc(chunk.size));
+			
+			if(!chunk.data)
+				throw std::bad_alloc();
+			
+			_chunks.push_back(chunk);
+			
+			_chunk = _chunks.size() - 1;
+			_offset = size;
+			
+			return chunk.data;
+		}
+		
+		void reset()
+		{
+			// Oversized chunks are the result of unusually large allocations, don't hold on to them
+			for(auto& chunk : _chunks)
+			{
+				if(chunk.size > _chunk_size)
+				{
+					std::free(chunk.data);
+					chunk.data = nullptr;
+				}
+			}
+			
+			_chunks.erase(std::remove_if(_chunks.begin(), _chunks.end(), [](const chunk& chunk) { return (chunk.data == nullptr); }), _chunks.end());
+			
+			_chunk = 0;
+			_offset = 0;
+		}
+		
+	private:
+		struct chunk
+		{
+			char *data;
+			size_t size;
+		};
+		
+		size_t _chunk_size;
+		size_t _chunk;
+		size_t _offset;
+		std::vector<chunk> _chunks;
+	};
+}
+
+#endif /* _RATATOSKR_ARENA_H_ */
@@ -0,0 +1,770 @@
+//
+//  rkasyncfileloggingengine.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "rkasyncfileloggingengine.h"
+
+// Define RATATOSKR_IO_URING to 0 to always use the thread pool
+#ifndef RATATOSKR_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RATATOSKR_IO_URING 1
+#endif
+#endif
+#endif
+
+#if RATATOSKR_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+using namespace ratatoskr;
+
+// Index reported for completed syncs
+static const size_t __sync_index = SIZE_MAX;
+
+struct async_file_logging_engine::completion
+{
+	size_t index; // Buffer index or __sync_index
+	int64_t result; // Bytes written, or a negative errno
+};
+
+// ---------------------
+// MARK: -
+// MARK: io_queue
+// ---------------------
+
+class async_file_logging_engine::io_queue
+{
+public:
+	virtual ~io_queue() {}
+	
+	// Both return false if the request couldn't be submitted
+	virtual bool write(size_t index, const char *data, size_t length, uint64_t offset) = 0;
+	virtual bool sync() = 0; // Only runs once all earlier writes completed
+	
+	// Appends finished requests, waits for at least one if wait is set
+	virtual bool reap(std::vector<completion>& completions, bool wait) = 0;
+};
+
+namespace
+{
+	int sync_file(int fd)
+	{
+#if defined(__APPLE__)
+		return ::fsync(fd);
+#else
+		return ::fdatasync(fd);
+#endif
+	}
+	
+	// Fallback for platforms and kernels without io_uring, the writes happen on a couple of threads instead
+	class thread_pool_queue : public async_file_logging_engine::io_queue
+	{
+	public:
+		thread_pool_queue(int fd, size_t threads) :
+			_fd(fd),
+			_submitted(0),
+			_written(0),
+			_stop(false)
+		{
+			for(size_t i = 0; i < threads; i ++)
+				_threads.emplace_back(std::bind(&thread_pool_queue::run, this));
+		}
+		
+		~thread_pool_queue() override
+		{
+			{
+				std::lock_guard<std::mutex> lock(_lock);
+				_stop = true;
+			}
+			
+			_work.notify_all();
+			
+			for(auto& thread : _threads)
+				thread.join();
+		}
+		
+		bool write(size_t index, const char *data, size_t length, uint64_t offset) override
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			
+			_jobs.push_back({ index, data, length, offset, 0 });
+			_submitted ++;
+			
+			_work.notify_one();
+			return true;
+		}
+		
+		bool sync() override
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			
+			_jobs.push_back({ __sync_index, nullptr, 0, 0, _submitted });
+			_work.notify_one();
+			
+			return true;
+		}
+		
+		bool reap(std::vector<async_file_logging_engine::completion>& completions, bool wait) override
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			
+			if(wait)
+				_done.wait(lock, [this]{ return !_finished.empty(); });
+			
+			completions.insert(completions.end(), _finished.begin(), _finished.end());
+			_finished.clear();
+			
+			return true;
+		}
+		
+	private:
+		struct job
+		{
+			size_t index;
+			const char *data;
+			size_t length;
+			uint64_t offset;
+			uint64_t barrier; // Writes that have to be finished before a sync can run
+		};
+		
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			
+			while(1)
+			{
+				_work.wait(lock, [this]{ return (_stop || !_jobs.empty()); });
+				
+				if(_jobs.empty())
+					break;
+				
+				job job = _jobs.front();
+				_jobs.pop_front();
+				
+				int64_t result;
+				
+				if(job.index == __sync_index)
+				{
+					_done.wait(lock, [&]{ return (_written >= job.barrier); });
+					
+					lock.unlock();
+					result = (sync_file(_fd) == 0) ? 0 : -errno;
+					lock.lock();
+				}
+				else
+				{
+					lock.unlock();
+					result = write_all(job);
+					lock.lock();
+					
+					_written ++;
+				}
+				
+				_finished.push_back({ job.index, result });
+				_done.notify_all();
+			}
+		}
+		
+		int64_t write_all(const job& job)
+		{
+			size_t written = 0;
+			
+			while(written < job.length)
+			{
+				ssize_t result = ::pwrite(_fd, job.data + written, job.length - written, static_cast<off_t>(job.offset + written));
+				
+				if(result < 0)
+				{
+					if(errno == EINTR)
+						continue;
+					
+					return -errno;
+				}
+				
+				written += static_cast<size_t>(result);
+			}
+			
+			return static_cast<int64_t>(written);
+		}
+		
+		int _fd;
+		
+		std::mutex _lock;
+		std::condition_variable _work;
+		std::condition_variable _done;
+		std::deque<job> _jobs;
+		std::vector<async_file_logging_engine::completion> _finished;
+		uint64_t _submitted;
+		uint64_t _written;
+		bool _stop;
+		
+		std::vector<std::thread> _threads;
+	};
+	
+#if RATATOSKR_IO_URING
+	// Talks to the kernel directly instead of going through liburing, which keeps the dependency list empty
+	class uring_queue : public async_file_logging_engine::io_queue
+	{
+	public:
+		static uring_queue *create(int fd, const std::vector<char *>& buffers, size_t buffer_size)
+		{
+			uring_queue *queue = new uring_queue(fd);
+			
+			if(!queue->setup(buffers, buffer_size))
+			{
+				delete queue;
+				return nullptr;
+			}
+			
+			return queue;
+		}
+		
+		~uring_queue() override
+		{
+			if(_sqes)
+				::munmap(_sqes, _sqes_size);
+			if(_cq_ring && _cq_ring != _sq_ring)
+				::munmap(_cq_ring, _cq_ring_size);
+			if(_sq_ring)
+				::munmap(_sq_ring, _sq_ring_size);
+			if(_ring_fd >= 0)
+				::close(_ring_fd);
+		}
+		
+		bool write(size_t index, const char *data, size_t length, uint64_t offset) override
+		{
+			size_t slot;
+			if(!acquire_request(slot))
+				return false;
+			
+			request& request = _requests[slot];
+			request.index = index;
+			request.data = data;
+			request.length = length;
+			request.offset = offset;
+			request.written = 0;
+			
+			return submit(slot);
+		}
+		
+		bool sync() override
+		{
+			size_t slot;
+			if(!acquire_request(slot))
+				return false;
+			
+			request& request = _requests[slot];
+			request.index = __sync_index;
+			request.data = nullptr;
+			request.length = 0;
+			request.offset = 0;
+			request.written = 0;
+			
+			return submit(slot);
+		}
+		
+		bool reap(std::vector<async_file_logging_engine::completion>& completions, bool wait) override
+		{
+			if(wait && !enter(0, 1, IORING_ENTER_GETEVENTS))
+				return false;
+			
+			unsigned head = *_cq_head;
+			unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+			
+			bool result = true;
+			
+			for(; head != tail; head ++)
+			{
+				const io_uring_cqe& cqe = _cqes[head & *_cq_mask];
+				
+				size_t slot = static_cast<size_t>(cqe.user_data);
+				request& request = _requests[slot];
+				
+				if(cqe.res >= 0 && request.index != __sync_index)
+				{
+					request.written += static_cast<size_t>(cqe.res);
+					
+					// Short write, submit the rest
+					if(cqe.res > 0 && request.written < request.length)
+					{
+						result = (result && submit(slot));
+						continue;
+					}
+				}
+				
+				int64_t status = (cqe.res < 0) ? cqe.res : static_cast<int64_t>(request.written);
+				if(cqe.res == 0 && request.index != __sync_index && request.written < request.length)
+					status = -EIO;
+				
+				completions.push_back({ request.index, status });
+				_free_requests.push_back(slot);
+			}
+			
+			__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+			return result;
+		}
+		
+	private:
+		struct request
+		{
+			size_t index;
+			const char *data;
+			size_t length;
+			uint64_t offset;
+			size_t written;
+		};
+		
+		uring_queue(int fd) :
+			_fd(fd),
+			_ring_fd(-1),
+			_sq_ring(nullptr),
+			_cq_ring(nullptr),
+			_sqes(nullptr),
+			_fixed(false)
+		{}
+		
+		bool setup(const std::vector<char *>& buffers, size_t buffer_size)
+		{
+			// Every buffer can be in flight, plus one sync
+			unsigned entries = 1;
+			while(entries < buffers.size() + 1)
+				entries <<= 1;
+			
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			
+			_ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+			if(_ring_fd < 0)
+				return false;
+			
+			_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			
+			if(params.features & IORING_FEAT_SINGLE_MMAP)
+				_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+			
+			_sq_ring = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+			if(_sq_ring == MAP_FAILED)
+			{
+				_sq_ring = nullptr;
+				return false;
+			}
+			
+			if(params.features & IORING_FEAT_SINGLE_MMAP)
+			{
+				_cq_ring = _sq_ring;
+			}
+			else
+			{
+				_cq_ring = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+				if(_cq_ring == MAP_FAILED)
+				{
+					_cq_ring = nullptr;
+					return false;
+				}
+			}
+			
+			_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			
+			void *sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+			if(sqes == MAP_FAILED)
+				return false;
+			
+			_sqes = static_cast<io_uring_sqe *>(sqes);
+			
+			char *sq = static_cast<char *>(_sq_ring);
+			char *cq = static_cast<char *>(_cq_ring);
+			
+			_sq_tail  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+			_sq_mask  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+			_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+			_cq_head  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+			_cq_tail  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+			_cq_mask  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+			_cqes     = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+			
+			// Registered buffers save the kernel from mapping the pages on every write. It fails when
+			// RLIMIT_MEMLOCK is too low, in which case plain writes still work
+			std::vector<iovec> vectors(buffers.size());
+			
+			for(size_t i = 0; i < buffers.size(); i ++)
+			{
+				vectors[i].iov_base = buffers[i];
+				vectors[i].iov_len  = buffer_size;
+			}
+			
+			_buffers = buffers;
+			_buffer_size = buffer_size;
+			_fixed = (::syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_BUFFERS, vectors.data(), static_cast<unsigned>(vectors.size())) == 0);
+			
+			_requests.resize(params.sq_entries);
+			_vectors.resize(params.sq_entries);
+			
+			for(size_t i = 0; i < _requests.size(); i ++)
+				_free_requests.push_back(_requests.size() - i - 1);
+			
+			return true;
+		}
+		
+		bool acquire_request(size_t& slot)
+		{
+			// The engine never has more than one sync and every buffer in flight, which always fits
+			if(_free_requests.empty())
+				return false;
+			
+			slot = _free_requests.back();
+			_free_requests.pop_back();
+			
+			return true;
+		}
+		
+		bool submit(size_t slot)
+		{
+			const request& request = _requests[slot];
+			
+			unsigned tail = *_sq_tail;
+			unsigned index = tail & *_sq_mask;
+			
+			io_uring_sqe& sqe = _sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			
+			sqe.fd = _fd;
+			sqe.user_data = slot;
+			
+			if(request.index == __sync_index)
+			{
+				sqe.opcode = IORING_OP_FSYNC;
+				sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+				sqe.flags = IOSQE_IO_DRAIN;
+			}
+			else if(_fixed)
+			{
+				sqe.opcode = IORING_OP_WRITE_FIXED;
+				sqe.addr = reinterpret_cast<uint64_t>(request.data + request.written);
+				sqe.len = static_cast<uint32_t>(request.length - request.written);
+				sqe.off = request.offset + request.written;
+				sqe.buf_index = static_cast<uint16_t>(request.index);
+			}
+			else
+			{
+				// Writev needs the iovec to stay around until the request is done
+				iovec& vector = _vectors[slot];
+				vector.iov_base = const_cast<char *>(request.data + request.written);
+				vector.iov_len = request.length - request.written;
+				
+				sqe.opcode = IORING_OP_WRITEV;
+				sqe.addr = reinterpret_cast<uint64_t>(&vector);
+				sqe.len = 1;
+				sqe.off = request.offset + request.written;
+			}
+			
+			_sq_array[index] = index;
+			__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+			
+			return enter(1, 0, 0);
+		}
+		
+		bool enter(unsigned submit, unsigned wait, unsigned flags)
+		{
+			while(1)
+			{
+				long result = ::syscall(__NR_io_uring_enter, _ring_fd, submit, wait, flags, nullptr, 0);
+				
+				if(result >= 0)
+					return true;
+				if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+					return false;
+				
+				std::this_thread::yield();
+			}
+		}
+		
+		int _fd;
+		int _ring_fd;
+		
+		void *_sq_ring;
+		void *_cq_ring;
+		size_t _sq_ring_size;
+		size_t _cq_ring_size;
+		io_uring_sqe *_sqes;
+		size_t _sqes_size;
+		
+		unsigned *_sq_tail;
+		unsigned *_sq_mask;
+		unsigned *_sq_array;
+		unsigned *_cq_head;
+		unsigned *_cq_tail;
+		unsigned *_cq_mask;
+		io_uring_cqe *_cqes;
+		
+		bool _fixed;
+		std::vector<char *> _buffers;
+		size_t _buffer_size;
+		
+		std::vector<request> _requests;
+		std::vector<iovec> _vectors;
+		std::vector<size_t> _free_requests;
+	};
+#endif
+}
+
+// ---------------------
+// MARK: -
+// MARK: async_file_logging_engine
+// ---------------------
+
+async_file_logging_engine::async_file_logging_engine(const std::string& path, size_t buffer_size, size_t buffer_count) :
+	_fd(-1),
+	_good(false),
+	_backend(backend::thread_pool),
+	_buffer_size(std::max(buffer_size, static_cast<size_t>(4096))),
+	_current(0),
+	_fill(0),
+	_in_flight(0),
+	_offset(0),
+	_dirty(false),
+	_sync_pending(false),
+	_last_sync(std::chrono::steady_clock::now()),
+	_sync_interval(0),
+	_bytes_written(0)
+{
+	buffer_count = std::max(buffer_count, static_cast<size_t>(2));
+	
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if(_fd < 0)
+		return;
+	
+	// Writes go to explicit offsets, starting at the end of whatever is in the file already
+	struct stat info;
+	if(::fstat(_fd, &info) == 0)
+		_offset = static_cast<uint64_t>(info.st_size);
+	
+	for(size_t i = 0; i < buffer_count; i ++)
+	{
+		void *buffer;
+		if(::posix_memalign(&buffer, 4096, _buffer_size) != 0)
+			throw std::bad_alloc();
+		
+		_buffers.push_back(static_cast<char *>(buffer));
+		_free.push_back(buffer_count - i - 1);
+	}
+	
+	_lengths.resize(buffer_count, 0);
+	_current = _buffers.size();
+	
+#if RATATOSKR_IO_URING
+	_queue.reset(uring_queue::create(_fd, _buffers, _buffer_size));
+	if(_queue)
+		_backend = backend::io_uring;
+#endif
+	
+	if(!_queue)
+		_queue.reset(new thread_pool_queue(_fd, 2));
+	
+	_good = true;
+}
+
+async_file_logging_engine::~async_file_logging_engine()
+{
+	finalize();
+	
+	for(char *buffer : _buffers)
+		std::free(buffer);
+}
+
+
+void async_file_logging_engine::set_sync_interval(std::chrono::milliseconds interval)
+{
+	_sync_interval.store(interval.count(), std::memory_order_relaxed);
+}
+
+bool async_file_logging_engine::is_good() const
+{
+	return _good;
+}
+
+
+
+void async_file_logging_engine::write(const message& message)
+{
+	size_t length = _formatter.get_max_length(message);
+	
+	// Format straight into the current buffer when the line fits, otherwise go through the scratch buffer and split it
+	if(_current != _buffers.size() && _buffer_size - _fill >= length)
+	{
+		_fill += _formatter.format(_buffers[_current] + _fill, message);
+		
+		if(_fill == _buffer_size)
+			submit_current();
+		
+		return;
+	}
+	
+	_line.clear();
+	_formatter.format(_line, message);
+	
+	append(_line.data(), _line.size());
+}
+
+void async_file_logging_engine::write_batch(const message_batch& batch)
+{
+	for(auto& message : batch)
+		write(message);
+}
+
+void async_file_logging_engine::append(const char *data, size_t length)
+{
+	while(length > 0 && _good)
+	{
+		if(_current == _buffers.size())
+		{
+			// All buffers are with the disk, this is the only place the engine waits for it
+			while(_free.empty() && _good)
+				reap(true);
+			
+			if(!_good)
+				return;
+			
+			_current = _free.back();
+			_free.pop_back();
+			_fill = 0;
+		}
+		
+		size_t count = std::min(length, _buffer_size - _fill);
+		std::memcpy(_buffers[_current] + _fill, data, count);
+		
+		_fill += count;
+		data += count;
+		length -= count;
+		
+		if(_fill == _buffer_size)
+			submit_current();
+	}
+}
+
+void async_file_logging_engine::submit_current()
+{
+	if(_current == _buffers.size() || _fill == 0)
+		return;
+	
+	_lengths[_current] = _fill;
+	
+	if(!_queue->write(_current, _buffers[_current], _fill, _offset))
+	{
+		_good = false;
+		return;
+	}
+	
+	_offset += _fill;
+	_in_flight ++;
+	_dirty = true;
+	
+	_current = _buffers.size();
+	_fill = 0;
+}
+
+void async_file_logging_engine::reap(bool wait)
+{
+	_completions.clear();
+	
+	if(!_queue->reap(_completions, wait))
+		_good = false;
+	
+	for(auto& completion : _completions)
+	{
+		_in_flight --;
+		
+		if(completion.result < 0)
+			_good = false;
+		
+		if(completion.index == __sync_index)
+		{
+			_sync_pending = false;
+			continue;
+		}
+		
+		if(completion.result > 0)
+			_bytes_written.fetch_add(static_cast<uint64_t>(completion.result), std::memory_order_relaxed);
+		
+		_free.push_back(completion.index);
+	}
+}
+
+void async_file_logging_engine::flush()
+{
+	if(!_good)
+		return;
+	
+	submit_current();
+	reap(false);
+	
+	int64_t interval = _sync_interval.load(std::memory_order_relaxed);
+	auto now = std::chrono::steady_clock::now();
+	
+	// Only one sync is in flight at a time, a slow disk just pushes the next one back
+	if(_good && interval > 0 && _dirty && !_sync_pending && now - _last_sync >= std::chrono::milliseconds(interval))
+	{
+		if(_queue->sync())
+		{
+			_in_flight ++;
+			_sync_pending = true;
+			_dirty = false;
+			_last_sync = now;
+		}
+		else
+		{
+			_good = false;
+		}
+	}
+}
+
+void async_file_logging_engine::finalize()
+{
+	if(_fd < 0)
+		return;
+	
+	if(_good)
+		submit_current();
+	
+	while(_in_flight > 0)
+	{
+		reap(true);
+		
+		if(!_good)
+			break;
+	}
+	
+	_queue.reset();
+	
+	::close(_fd);
+	_fd = -1;
+	_good = false;
+}
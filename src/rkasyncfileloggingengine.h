@@ -0,0 +1,95 @@
+//
+//  rkasyncfileloggingengine.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_ASYNCFILELOGGINGENGINE_H_
+#define _RATATOSKR_ASYNCFILELOGGINGENGINE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include "rkloggingengine.h"
+
+namespace ratatoskr
+{
+	// File engine that never waits for the disk while there are free buffers. Full buffers are handed
+	// to io_uring on Linux, or to a small pool of pwrite() threads where io_uring isn't available,
+	// and get reused once their write completed.
+	class async_file_logging_engine : public logging_engine
+	{
+	public:
+		enum class backend
+		{
+			io_uring,
+			thread_pool
+		};
+		
+		async_file_logging_engine(const std::string& path, size_t buffer_size = 256 * 1024, size_t buffer_count = 16);
+		~async_file_logging_engine() override;
+		
+		void set_sync_interval(std::chrono::milliseconds interval); // Periodic fdatasync(), 0 (the default) disables it
+		
+		backend get_backend() const { return _backend; }
+		uint64_t get_bytes_written() const { return _bytes_written.load(std::memory_order_relaxed); }
+		
+		line_formatter& get_formatter() { return _formatter; }
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+		// Backends, defined in the implementation
+		class io_queue;
+		struct completion;
+		
+	private:
+		void append(const char *data, size_t length);
+		void submit_current();
+		void reap(bool wait);
+		
+		int _fd;
+		bool _good;
+		backend _backend;
+		std::unique_ptr<io_queue> _queue;
+		
+		size_t _buffer_size;
+		std::vector<char *> _buffers;
+		std::vector<size_t> _lengths; // Bytes submitted per buffer
+		std::vector<size_t> _free;
+		std::vector<completion> _completions;
+		size_t _current; // Buffer being filled, or _buffers.size()
+		size_t _fill;
+		size_t _in_flight;
+		
+		line_formatter _formatter;
+		small_buffer<512> _line; // Lines that don't fit into the current buffer
+		
+		uint64_t _offset;
+		bool _dirty; // Written since the last sync
+		bool _sync_pending;
+		std::chrono::steady_clock::time_point _last_sync;
+		std::atomic<int64_t> _sync_interval;
+		std::atomic<uint64_t> _bytes_written;
+	};
+}
+
+#endif /* _RATATOSKR_ASYNCFILELOGGINGENGINE_H_ */
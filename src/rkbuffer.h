@@ -0,0 +1,209 @@
+//
+//  rkbuffer.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_BUFFER_H_
+#define _RATATOSKR_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace ratatoskr
+{
+	// Growable byte buffer that lives in storage provided by its subclass (see small_buffer) and only
+	// moves to the heap once that storage is exhausted. Holds up to 2GB, which keeps the header small
+	// enough to embed several of them into every message.
+	class buffer
+	{
+	public:
+		const char *data() const { return _data; }
+		char *data() { return _data; }
+		size_t size() const { return _size; }
+		size_t capacity() const { return _capacity; }
+		bool empty() const { return (_size == 0); }
+		
+		void clear() { _size = 0; }
+		
+		void append(const char *data, size_t length)
+		{
+			if(_size + length > capacity())
+				grow(_size + length);
+			
+			std::memcpy(_data + _size, data, length);
+			_size += static_cast<uint32_t>(length);
+		}
+		
+		void append(const buffer& other) { append(other.data(), other.size()); }
+		
+		void push_back(char c)
+		{
+			if(_size == capacity())
+				grow(_size + 1);
+			
+			_data[_size ++] = c;
+		}
+		
+		// Makes room for at least length bytes at the end, which can be written to directly and then committed
+		char *reserve(size_t length)
+		{
+			if(_size + length > capacity())
+				grow(_size + length);
+			
+			return _data + _size;
+		}
+		
+		void commit(size_t length) { _size += static_cast<uint32_t>(length); }
+		
+	protected:
+		buffer(char *storage, size_t capacity) :
+			_data(storage),
+			_size(0),
+			_capacity(static_cast<uint32_t>(capacity)),
+			_heap(false)
+		{}
+		
+		~buffer()
+		{
+			if(_heap)
+				std::free(_data);
+		}
+		
+		buffer(const buffer&) = delete;
+		buffer& operator= (const buffer&) = delete;
+		
+		void assign(const buffer& other)
+		{
+			_size = 0;
+			append(other.data(), other.size());
+		}
+		
+		void steal(buffer& other, char *storage, size_t capacity) noexcept
+		{
+			if(_heap)
+				std::free(_data);
+			
+			if(other._heap)
+			{
+				_data = other._data;
+				_size = other._size;
+				_capacity = other._capacity;
+				_heap = true;
+				
+				other._data = nullptr;
+				other._heap = false;
+			}
+			else
+			{
+				_data = storage;
+				_capacity = static_cast<uint32_t>(capacity);
+				_heap = false;
+				
+				std::memcpy(_data, other._data, other._size);
+				_size = other._size;
+			}
+			
+			other._size = 0;
+		}
+		
+		void reset(char *storage, size_t capacity) noexcept
+		{
+			// Used to point an emptied buffer back at its inline storage
+			_data = storage;
+			_capacity = static_cast<uint32_t>(capacity);
+		}
+		
+	private:
+		void grow(size_t required)
+		{
+			if(required > max_capacity)
+				throw std::bad_alloc();
+			
+			size_t grown = (capacity() < max_capacity / 2) ? capacity() * 2 : max_capacity;
+			if(grown < required)
+				grown = required;
+			
+			char *data = static_cast<char *>(std::malloc(grown));
+			if(!data)
+				throw std::bad_alloc();
+			
+			std::memcpy(data, _data, _size);
+			
+			if(_heap)
+				std::free(_data);
+			
+			_data = data;
+			_capacity = static_cast<uint32_t>(grown);
+			_heap = true;
+		}
+		
+		static const size_t max_capacity = 0x7fffffff;
+		
+		char *_data;
+		uint32_t _size;
+		uint32_t _capacity : 31;
+		uint32_t _heap : 1;
+	};
+	
+	template<size_t N>
+	class small_buffer : public buffer
+	{
+	public:
+		small_buffer() :
+			buffer(_storage, N)
+		{}
+		
+		small_buffer(const small_buffer& other) :
+			buffer(_storage, N)
+		{
+			assign(other);
+		}
+		
+		small_buffer(small_buffer&& other) noexcept :
+			buffer(_storage, N)
+		{
+			steal(other, _storage, N);
+			other.reset(other._storage, N);
+		}
+		
+		small_buffer& operator= (const small_buffer& other)
+		{
+			if(this != &other)
+				assign(other);
+			
+			return *this;
+		}
+		
+		small_buffer& operator= (small_buffer&& other) noexcept
+		{
+			if(this != &other)
+			{
+				steal(other, _storage, N);
+				other.reset(other._storage, N);
+			}
+			
+			return *this;
+		}
+		
+	private:
+		char _storage[N];
+	};
+}
+
+#endif /* _RATATOSKR_BUFFER_H_ */
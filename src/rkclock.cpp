@@ -0,0 +1,84 @@
+//
+//  rkclock.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "rkclock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace ratatoskr;
+
+timekeeper::timekeeper() :
+	_ns_per_cycle(1.0)
+{
+	_origin_steady = steady_stamp();
+	_origin_cycles = cycle_stamp();
+	
+	calibrate();
+}
+
+uint64_t timekeeper::cycle_stamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t value;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (value));
+	
+	return value;
+#else
+	return steady_stamp();
+#endif
+}
+
+void timekeeper::calibrate()
+{
+	_anchor_system = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	_anchor_steady = steady_stamp();
+	_anchor_cycles = cycle_stamp();
+	
+	uint64_t elapsed = _anchor_steady - _origin_steady;
+	uint64_t cycles  = _anchor_cycles - _origin_cycles;
+	
+	// Below a millisecond the rate is too imprecise, keep the last one. That only happens
+	// for the very first calibrations, by then no cycle stamps have been taken in all likelihood
+	if(elapsed >= 1000000 && cycles > 0)
+		_ns_per_cycle = static_cast<double>(elapsed) / static_cast<double>(cycles);
+}
+
+std::chrono::system_clock::time_point timekeeper::convert(clock_source source, uint64_t stamp) const
+{
+	int64_t offset = 0; // Nanoseconds relative to the system anchor
+	
+	switch(source)
+	{
+		case clock_source::system:
+			return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(stamp)));
+			
+		case clock_source::steady:
+			offset = static_cast<int64_t>(stamp - _anchor_steady);
+			break;
+			
+		case clock_source::cycle_counter:
+			offset = static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(stamp - _anchor_cycles)) * _ns_per_cycle);
+			break;
+	}
+	
+	return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(_anchor_system + offset)));
+}
@@ -0,0 +1,79 @@
+//
+//  rkclock.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_CLOCK_H_
+#define _RATATOSKR_CLOCK_H_
+
+#include <chrono>
+#include <cstdint>
+
+namespace ratatoskr
+{
+	enum class clock_source : uint8_t
+	{
+		system, // std::chrono::system_clock, no conversion needed
+		steady, // std::chrono::steady_clock, converted with the offset to the system clock at flush time
+		cycle_counter // The CPUs time stamp counter where available, steady_clock otherwise
+	};
+	
+	// Producer threads only take raw stamps, the flush thread calibrates the clock once per batch and
+	// converts the stamps to wall clock time. Everything but stamp() has to be called from one thread.
+	class timekeeper
+	{
+	public:
+		timekeeper();
+		
+		static uint64_t stamp(clock_source source)
+		{
+			switch(source)
+			{
+				case clock_source::system:
+					return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+				case clock_source::steady:
+					return steady_stamp();
+				case clock_source::cycle_counter:
+					return cycle_stamp();
+			}
+			
+			return 0;
+		}
+		
+		void calibrate();
+		std::chrono::system_clock::time_point convert(clock_source source, uint64_t stamp) const;
+		
+	private:
+		static uint64_t steady_stamp()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+		
+		static uint64_t cycle_stamp();
+		
+		// Taken once, the longer the distance to the anchor, the more accurate the cycle rate gets
+		uint64_t _origin_steady;
+		uint64_t _origin_cycles;
+		
+		// Taken by calibrate()
+		int64_t _anchor_system;
+		uint64_t _anchor_steady;
+		uint64_t _anchor_cycles;
+		double _ns_per_cycle;
+	};
+}
+
+#endif /* _RATATOSKR_CLOCK_H_ */
@@ -0,0 +1,320 @@
+//
+//  rkcompressedloggingengine.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rkcompressedloggingengine.h"
+
+// Define RATATOSKR_ZSTD or RATATOSKR_LZ4 to 1 to build with the codec, which requires linking against libzstd or liblz4
+#ifndef RATATOSKR_ZSTD
+#define RATATOSKR_ZSTD 0
+#endif
+
+#ifndef RATATOSKR_LZ4
+#define RATATOSKR_LZ4 0
+#endif
+
+#if RATATOSKR_ZSTD
+#include <zstd.h>
+#endif
+
+#if RATATOSKR_LZ4
+#include <lz4frame.h>
+#endif
+
+using namespace ratatoskr;
+
+// Batches waiting for the compression thread before flush() waits for it
+static const size_t __max_pending = 4;
+
+compressed_logging_engine::compressed_logging_engine(const std::string& path, codec compression, int level) :
+	_fd(-1),
+	_codec(compression),
+	_level(level),
+	_good(false),
+	_context(nullptr),
+	_stop(false),
+	_bytes_in(0),
+	_bytes_out(0)
+{
+	if(!is_available(_codec))
+		return;
+	
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(_fd < 0)
+		return;
+	
+#if RATATOSKR_ZSTD
+	if(_codec == codec::zstd)
+		_context = ZSTD_createCCtx();
+#endif
+	
+	_good = true;
+	_thread = std::thread(std::bind(&compressed_logging_engine::run, this));
+}
+
+compressed_logging_engine::~compressed_logging_engine()
+{
+	finalize();
+}
+
+
+bool compressed_logging_engine::is_available(codec compression)
+{
+	switch(compression)
+	{
+		case codec::none:
+			return true;
+		case codec::lz4:
+#if RATATOSKR_LZ4
+			return true;
+#else
+			return false;
+#endif
+		case codec::zstd:
+#if RATATOSKR_ZSTD
+			return true;
+#else
+			return false;
+#endif
+	}
+	
+	return false;
+}
+
+compressed_logging_engine::codec compressed_logging_engine::get_default_codec()
+{
+	if(is_available(codec::zstd))
+		return codec::zstd;
+	if(is_available(codec::lz4))
+		return codec::lz4;
+	
+	return codec::none;
+}
+
+void compressed_logging_engine::set_level(int level)
+{
+	_level.store(level, std::memory_order_relaxed);
+}
+
+bool compressed_logging_engine::is_good() const
+{
+	return _good.load(std::memory_order_relaxed);
+}
+
+
+
+void compressed_logging_engine::write(const message& message)
+{
+	size_t size = _current.size();
+	
+	_current.resize(size + _formatter.get_max_length(message));
+	_current.resize(size + _formatter.format(_current.data() + size, message));
+}
+
+void compressed_logging_engine::write_batch(const message_batch& batch)
+{
+	// Grow the frame once for the whole batch
+	size_t length = _current.size();
+	
+	for(auto& message : batch)
+		length += _formatter.get_max_length(message);
+	
+	_current.reserve(length);
+	
+	for(auto& message : batch)
+		write(message);
+}
+
+void compressed_logging_engine::flush()
+{
+	if(_current.empty() || !_thread.joinable())
+		return;
+	
+	std::unique_lock<std::mutex> lock(_lock);
+	
+	// Only wait if the compression thread fell behind by several batches
+	_signal.wait(lock, [this]{ return (_pending.size() < __max_pending); });
+	
+	_pending.push_back(std::move(_current));
+	
+	if(!_spare.empty())
+	{
+		_current = std::move(_spare.back());
+		_spare.pop_back();
+	}
+	else
+	{
+		_current = std::vector<char>();
+	}
+	
+	_current.clear();
+	_signal.notify_all();
+}
+
+void compressed_logging_engine::finalize()
+{
+	flush();
+	
+	if(_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			_stop = true;
+		}
+		
+		_signal.notify_all();
+		_thread.join();
+	}
+	
+#if RATATOSKR_ZSTD
+	if(_codec == codec::zstd && _context)
+		ZSTD_freeCCtx(static_cast<ZSTD_CCtx *>(_context));
+#endif
+	
+	_context = nullptr;
+	
+	if(_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+	
+	_good = false;
+}
+
+
+
+void compressed_logging_engine::run()
+{
+	std::vector<char> output;
+	std::unique_lock<std::mutex> lock(_lock);
+	
+	while(1)
+	{
+		_signal.wait(lock, [this]{ return (_stop || !_pending.empty()); });
+		
+		// Pending batches are still written when stopping
+		if(_pending.empty())
+			break;
+		
+		std::vector<char> input = std::move(_pending.front());
+		_pending.pop_front();
+		
+		_signal.notify_all();
+		lock.unlock();
+		
+		if(_good.load(std::memory_order_relaxed))
+		{
+			bool result = compress(input, output) && write_all(output.data(), output.size());
+			
+			if(result)
+			{
+				_bytes_in.fetch_add(input.size(), std::memory_order_relaxed);
+				_bytes_out.fetch_add(output.size(), std::memory_order_relaxed);
+			}
+			else
+			{
+				_good.store(false, std::memory_order_relaxed);
+			}
+		}
+		
+		input.clear();
+		lock.lock();
+		
+		_spare.push_back(std::move(input));
+	}
+}
+
+bool compressed_logging_engine::compress(const std::vector<char>& input, std::vector<char>& output)
+{
+	switch(_codec)
+	{
+		case codec::none:
+			output.assign(input.begin(), input.end());
+			return true;
+			
+		case codec::lz4:
+		{
+#if RATATOSKR_LZ4
+			int level = _level.load(std::memory_order_relaxed);
+			
+			LZ4F_preferences_t preferences;
+			std::memset(&preferences, 0, sizeof(preferences));
+			
+			preferences.compressionLevel = level;
+			preferences.frameInfo.contentSize = input.size();
+			preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+			
+			output.resize(LZ4F_compressFrameBound(input.size(), &preferences));
+			
+			size_t result = LZ4F_compressFrame(output.data(), output.size(), input.data(), input.size(), &preferences);
+			if(LZ4F_isError(result))
+				return false;
+			
+			output.resize(result);
+			return true;
+#else
+			return false;
+#endif
+		}
+			
+		case codec::zstd:
+		{
+#if RATATOSKR_ZSTD
+			int level = _level.load(std::memory_order_relaxed);
+			
+			output.resize(ZSTD_compressBound(input.size()));
+			
+			size_t result = ZSTD_compressCCtx(static_cast<ZSTD_CCtx *>(_context), output.data(), output.size(), input.data(), input.size(), (level > 0) ? level : ZSTD_CLEVEL_DEFAULT);
+			if(ZSTD_isError(result))
+				return false;
+			
+			output.resize(result);
+			return true;
+#else
+			return false;
+#endif
+		}
+	}
+	
+	return false;
+}
+
+bool compressed_logging_engine::write_all(const char *data, size_t length)
+{
+	while(length > 0)
+	{
+		ssize_t result = ::write(_fd, data, length);
+		
+		if(result < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			
+			return false;
+		}
+		
+		data += result;
+		length -= static_cast<size_t>(result);
+	}
+	
+	return true;
+}
@@ -0,0 +1,96 @@
+//
+//  rkcompressedloggingengine.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_COMPRESSEDLOGGINGENGINE_H_
+#define _RATATOSKR_COMPRESSEDLOGGINGENGINE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rkloggingengine.h"
+
+namespace ratatoskr
+{
+	// Compresses every flushed batch into an independent zstd or LZ4 frame on a thread of its own. Frames
+	// can be decompressed with the regular command line tools, a truncated file only loses its last frame.
+	// The codecs are opt-in, build with RATATOSKR_ZSTD=1 or RATATOSKR_LZ4=1 and link against libzstd/liblz4.
+	class compressed_logging_engine : public logging_engine
+	{
+	public:
+		enum class codec
+		{
+			none, // Plain text
+			lz4,
+			zstd
+		};
+		
+		// Level 0 picks the codecs default, higher levels trade speed for ratio. Asking for a codec that
+		// isn't available leaves the engine not good, get_default_codec() falls back to codec::none
+		compressed_logging_engine(const std::string& path, codec compression = get_default_codec(), int level = 0);
+		~compressed_logging_engine() override;
+		
+		static bool is_available(codec compression);
+		static codec get_default_codec();
+		
+		void set_level(int level);
+		
+		codec get_codec() const { return _codec; }
+		uint64_t get_bytes_in() const { return _bytes_in.load(std::memory_order_relaxed); }
+		uint64_t get_bytes_out() const { return _bytes_out.load(std::memory_order_relaxed); }
+		
+		line_formatter& get_formatter() { return _formatter; }
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+	private:
+		void run();
+		bool compress(const std::vector<char>& input, std::vector<char>& output);
+		bool write_all(const char *data, size_t length);
+		
+		int _fd;
+		codec _codec;
+		std::atomic<int> _level;
+		std::atomic<bool> _good;
+		void *_context; // Codec specific, only touched by the compression thread
+		
+		line_formatter _formatter;
+		std::vector<char> _current;
+		
+		std::mutex _lock;
+		std::condition_variable _signal;
+		std::deque<std::vector<char>> _pending;
+		std::vector<std::vector<char>> _spare;
+		bool _stop;
+		
+		std::atomic<uint64_t> _bytes_in;
+		std::atomic<uint64_t> _bytes_out;
+		
+		std::thread _thread;
+	};
+}
+
+#endif /* _RATATOSKR_COMPRESSEDLOGGINGENGINE_H_ */
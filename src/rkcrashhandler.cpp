@@ -0,0 +1,236 @@
+//
+//  rkcrashhandler.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "rkcrashhandler.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	enum crash_state
+	{
+		idle,
+		writing,
+		written
+	};
+	
+	const size_t max_watched = 16;
+	const int handled_signals[] = { SIGSEGV, SIGABRT, SIGBUS };
+	const size_t handled_signal_count = sizeof(handled_signals) / sizeof(handled_signals[0]);
+	
+	// Read by the handlers, so everything is either atomic or only changed while they aren't installed
+	std::atomic<logger *> __watched[max_watched];
+	std::atomic<int> __crash_fd(-1);
+	std::atomic<int> __crash_state(idle);
+	
+	std::mutex __install_lock;
+	bool __installed = false;
+	struct sigaction __previous_actions[handled_signal_count];
+	std::terminate_handler __previous_terminate = nullptr;
+	char *__alternate_stack = nullptr;
+	
+	void write_text(int fd, const char *text)
+	{
+		size_t length = std::strlen(text);
+		
+		while(length > 0)
+		{
+			ssize_t result = ::write(fd, text, length);
+			
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				
+				return;
+			}
+			
+			text += result;
+			length -= static_cast<size_t>(result);
+		}
+	}
+	
+	const char *signal_name(int signal)
+	{
+		switch(signal)
+		{
+			case SIGSEGV:
+				return "SIGSEGV";
+			case SIGABRT:
+				return "SIGABRT";
+			case SIGBUS:
+				return "SIGBUS";
+		}
+		
+		return "fatal signal";
+	}
+	
+	void handle_signal(int signal)
+	{
+		int error = errno;
+		
+		crash_handler::write_pending(signal_name(signal));
+		
+		// The signal is blocked while its handler runs, so raising it again hands it to
+		// the previous handler, or the default action, once this one returns
+		for(size_t i = 0; i < handled_signal_count; i ++)
+		{
+			if(handled_signals[i] == signal)
+				sigaction(signal, &__previous_actions[i], nullptr);
+		}
+		
+		errno = error;
+		raise(signal);
+	}
+	
+	void handle_terminate()
+	{
+		crash_handler::write_pending("std::terminate()");
+		
+		if(__previous_terminate)
+			__previous_terminate();
+		
+		std::abort();
+	}
+}
+
+void crash_handler::install(int fd)
+{
+	std::lock_guard<std::mutex> lock(__install_lock);
+	
+	__crash_fd.store(fd);
+	watch(logger::get_shared_instance());
+	
+	if(__installed)
+		return;
+	
+	// Stack overflows can only be reported on a stack of their own
+	if(!__alternate_stack)
+		__alternate_stack = static_cast<char *>(std::malloc(64 * 1024));
+	
+	if(__alternate_stack)
+	{
+		stack_t stack;
+		std::memset(&stack, 0, sizeof(stack));
+		
+		stack.ss_sp = __alternate_stack;
+		stack.ss_size = 64 * 1024;
+		
+		sigaltstack(&stack, nullptr);
+	}
+	
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	
+	action.sa_handler = &handle_signal;
+	action.sa_flags = SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+	
+	for(size_t i = 0; i < handled_signal_count; i ++)
+		sigaction(handled_signals[i], &action, &__previous_actions[i]);
+	
+	__previous_terminate = std::set_terminate(&handle_terminate);
+	__installed = true;
+}
+
+void crash_handler::uninstall()
+{
+	std::lock_guard<std::mutex> lock(__install_lock);
+	
+	if(!__installed)
+		return;
+	
+	for(size_t i = 0; i < handled_signal_count; i ++)
+		sigaction(handled_signals[i], &__previous_actions[i], nullptr);
+	
+	std::set_terminate(__previous_terminate);
+	
+	__previous_terminate = nullptr;
+	__installed = false;
+}
+
+void crash_handler::watch(logger *logger)
+{
+	for(size_t i = 0; i < max_watched; i ++)
+	{
+		if(__watched[i].load() == logger)
+			return;
+	}
+	
+	for(size_t i = 0; i < max_watched; i ++)
+	{
+		ratatoskr::logger *expected = nullptr;
+		
+		if(__watched[i].compare_exchange_strong(expected, logger))
+			return;
+	}
+}
+
+void crash_handler::unwatch(logger *logger)
+{
+	for(size_t i = 0; i < max_watched; i ++)
+	{
+		ratatoskr::logger *expected = logger;
+		__watched[i].compare_exchange_strong(expected, nullptr);
+	}
+}
+
+void crash_handler::write_pending(const char *reason)
+{
+	int state = idle;
+	
+	if(!__crash_state.compare_exchange_strong(state, writing))
+	{
+		// Another thread crashed at the same time, give it a chance to finish before the process goes down
+		struct timespec delay = { 0, 10 * 1000 * 1000 };
+		
+		for(size_t i = 0; i < 100 && __crash_state.load() == writing; i ++)
+			nanosleep(&delay, nullptr);
+		
+		return;
+	}
+	
+	int fd = __crash_fd.load();
+	
+	if(fd >= 0)
+	{
+		write_text(fd, "ratatoskr: ");
+		write_text(fd, reason);
+		write_text(fd, ", writing the messages that weren't flushed yet\n");
+		
+		for(size_t i = 0; i < max_watched; i ++)
+		{
+			logger *logger = __watched[i].load();
+			
+			if(logger)
+				logger->emergency_flush(fd);
+		}
+	}
+	
+	__crash_state.store(written);
+}
@@ -0,0 +1,47 @@
+//
+//  rkcrashhandler.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_CRASHHANDLER_H_
+#define _RATATOSKR_CRASHHANDLER_H_
+
+#include "rklogger.h"
+
+namespace ratatoskr
+{
+	// Opt-in handler for SIGSEGV, SIGABRT, SIGBUS and std::terminate(), which writes the messages the watched loggers
+	// haven't flushed yet to a file descriptor with logger::emergency_flush() before passing on to the handler that was
+	// installed before. Engines aren't involved, they might be what crashed. The alternate signal stack, which is
+	// needed to report stack overflows, only gets set up for the thread that calls install()
+	class crash_handler
+	{
+	public:
+		// Also watches the shared logger
+		static void install(int fd);
+		static void uninstall();
+		
+		// Up to 16 loggers at a time, loggers stop being watched when they are destroyed
+		static void watch(logger *logger);
+		static void unwatch(logger *logger);
+		
+		// What the handlers do, safe to call from other signal handlers. Only the first call writes anything,
+		// concurrent calls from other crashing threads wait for it to finish
+		static void write_pending(const char *reason);
+	};
+}
+
+#endif /* _RATATOSKR_CRASHHANDLER_H_ */
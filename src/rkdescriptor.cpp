@@ -0,0 +1,80 @@
+//
+//  rkdescriptor.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <vector>
+#include <mutex>
+#include "rkdescriptor.h"
+#include "rkspinlock.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	// Descriptors are registered once per call site, but looked up for every rendered message
+	struct descriptor_table
+	{
+		adaptive_lock lock;
+		std::vector<const descriptor *> descriptors;
+	};
+	
+	descriptor_table& get_descriptor_table()
+	{
+		static descriptor_table table;
+		return table;
+	}
+}
+
+descriptor::descriptor(log_level level, const char *format, const char *file, int line) :
+	_level(level),
+	_format(format),
+	_file(file),
+	_line(line)
+{
+	descriptor_table& table = get_descriptor_table();
+	std::lock_guard<decltype(table.lock)> lock(table.lock);
+	
+	table.descriptors.push_back(this);
+	_id = static_cast<uint32_t>(table.descriptors.size()); // 0 is reserved for records without a descriptor
+}
+
+const descriptor *descriptor::get_descriptor(uint32_t id)
+{
+	descriptor_table& table = get_descriptor_table();
+	std::lock_guard<decltype(table.lock)> lock(table.lock);
+	
+	if(id == 0 || id > table.descriptors.size())
+		return nullptr;
+	
+	return table.descriptors[id - 1];
+}
+
+const descriptor *descriptor::get_descriptor_nonblocking(uint32_t id)
+{
+	descriptor_table& table = get_descriptor_table();
+	bool locked = table.lock.try_lock();
+	
+	const descriptor *result = nullptr;
+	
+	if(id > 0 && id <= table.descriptors.size())
+		result = table.descriptors[id - 1];
+	
+	if(locked)
+		table.lock.unlock();
+	
+	return result;
+}
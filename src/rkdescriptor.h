@@ -0,0 +1,115 @@
+//
+//  rkdescriptor.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_DESCRIPTOR_H_
+#define _RATATOSKR_DESCRIPTOR_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace ratatoskr
+{
+	enum class log_level : int;
+	
+	// Static part of a log statement created by the rklog() macros. Every call site owns exactly
+	// one descriptor, messages only carry its id and the binary arguments.
+	class descriptor
+	{
+	public:
+		descriptor(log_level level, const char *format, const char *file, int line);
+		
+		descriptor(const descriptor&) = delete;
+		descriptor& operator= (const descriptor&) = delete;
+		
+		uint32_t get_id() const { return _id; }
+		log_level get_level() const { return _level; }
+		const char *get_format() const { return _format; }
+		const char *get_file() const { return _file; }
+		int get_line() const { return _line; }
+		
+		static const descriptor *get_descriptor(uint32_t id);
+		
+		// Never blocks, if the table is locked it gets read anyway. Only meant for crash handlers, where
+		// the thread holding the lock might never get to release it
+		static const descriptor *get_descriptor_nonblocking(uint32_t id);
+		
+	private:
+		uint32_t _id;
+		log_level _level;
+		const char *_format;
+		const char *_file;
+		int _line;
+	};
+	
+	namespace detail
+	{
+		constexpr bool is_brace(char c)
+		{
+			return (c == '{' || c == '}');
+		}
+		
+		// Number of braces directly in front of end, but not before begin
+		constexpr size_t count_brace_run(const char *format, size_t begin, size_t end)
+		{
+			return (end > begin && is_brace(format[end - 1])) ? 1 + count_brace_run(format, begin, end - 1) : 0;
+		}
+		
+		// Moves the split point past the second character of a {{, }} or {} pair, braces pair up from the start of their run
+		constexpr size_t placeholder_split(const char *format, size_t begin, size_t middle)
+		{
+			return ((count_brace_run(format, begin, middle) % 2) == 1 && is_brace(format[middle])) ? middle + 1 : middle;
+		}
+		
+		constexpr int count_placeholder_pair(const char *format, size_t begin)
+		{
+			return !is_brace(format[begin]) ? (is_brace(format[begin + 1]) ? -1 : 0) :
+				(format[begin] == '{' && format[begin + 1] == '}') ? 1 :
+				(format[begin] == format[begin + 1]) ? 0 : -1;
+		}
+		
+		constexpr int add_placeholders(int left, int right)
+		{
+			return (left < 0 || right < 0) ? -1 : left + right;
+		}
+		
+		// Splits the range in half, so the recursion depth only grows with the logarithm of the format length
+		constexpr int count_placeholders(const char *format, size_t begin, size_t end)
+		{
+			return (end - begin == 0) ? 0 :
+				(end - begin == 1) ? (is_brace(format[begin]) ? -1 : 0) :
+				(end - begin == 2) ? count_placeholder_pair(format, begin) :
+				add_placeholders(count_placeholders(format, begin, placeholder_split(format, begin, begin + (end - begin) / 2)),
+								 count_placeholders(format, placeholder_split(format, begin, begin + (end - begin) / 2), end));
+		}
+		
+		// Returns the number of {} placeholders in the format string or -1 if it contains unbalanced braces.
+		// {{ and }} are escapes for literal braces.
+		template<size_t Length>
+		constexpr int count_placeholders(const char (&format)[Length])
+		{
+			return count_placeholders(format, 0, Length - 1);
+		}
+		
+		// Only ever used in unevaluated contexts to count the arguments of a macro invocation
+		template<class ... Args>
+		std::integral_constant<int, sizeof...(Args)> count_arguments(const Args& ...);
+	}
+}
+
+#endif /* _RATATOSKR_DESCRIPTOR_H_ */
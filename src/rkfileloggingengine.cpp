@@ -0,0 +1,265 @@
+//
+//  rkfileloggingengine.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "rkfileloggingengine.h"
+
+using namespace ratatoskr;
+
+// Upper bound for the number of chunks handed to a single writev(), also the point
+// at which write() stops collecting and writes early
+static const size_t __max_chunks = 64;
+
+file_logging_engine::file_logging_engine(const std::string& path, size_t chunk_size) :
+	_path(path),
+	_fd(-1),
+	_good(false),
+	_file_size(0),
+	_chunk_size(std::max(chunk_size, static_cast<size_t>(4096))),
+	_rotation_size(0),
+	_rotation_interval(0),
+	_max_files(5),
+	_bytes_written(0)
+{
+	open_file();
+}
+
+file_logging_engine::~file_logging_engine()
+{
+	finalize();
+	
+	for(auto& chunk : _spare)
+		std::free(chunk.data);
+}
+
+
+void file_logging_engine::set_rotation_size(uint64_t bytes)
+{
+	_rotation_size.store(bytes, std::memory_order_relaxed);
+}
+
+void file_logging_engine::set_rotation_interval(std::chrono::seconds interval)
+{
+	_rotation_interval.store(interval.count(), std::memory_order_relaxed);
+}
+
+void file_logging_engine::set_max_files(size_t count)
+{
+	_max_files.store(count, std::memory_order_relaxed);
+}
+
+
+
+bool file_logging_engine::is_good() const
+{
+	return _good;
+}
+
+void file_logging_engine::write(const message& message)
+{
+	chunk& chunk = acquire_chunk(_formatter.get_max_length(message));
+	chunk.size += _formatter.format(chunk.data + chunk.size, message);
+}
+
+void file_logging_engine::write_batch(const message_batch& batch)
+{
+	// write() is final, so this is a direct call per message rather than a virtual one
+	for(auto& message : batch)
+		write(message);
+}
+
+void file_logging_engine::flush()
+{
+	write_chunks();
+	
+	uint64_t rotation_size = _rotation_size.load(std::memory_order_relaxed);
+	int64_t rotation_interval = _rotation_interval.load(std::memory_order_relaxed);
+	
+	bool rotate_size = (rotation_size > 0 && _file_size >= rotation_size);
+	bool rotate_time = (rotation_interval > 0 && std::chrono::steady_clock::now() - _opened >= std::chrono::seconds(rotation_interval));
+	
+	if(_good && (rotate_size || rotate_time))
+		rotate();
+}
+
+void file_logging_engine::finalize()
+{
+	write_chunks();
+	close_file();
+}
+
+
+
+file_logging_engine::chunk& file_logging_engine::acquire_chunk(size_t length)
+{
+	if(!_chunks.empty())
+	{
+		chunk& last = _chunks.back();
+		if(last.capacity - last.size >= length)
+			return last;
+	}
+	
+	if(_chunks.size() >= __max_chunks)
+		write_chunks();
+	
+	chunk chunk;
+	
+	if(!_spare.empty() && length <= _chunk_size)
+	{
+		chunk = _spare.back();
+		_spare.pop_back();
+	}
+	else
+	{
+		chunk.capacity = std::max(length, _chunk_size);
+		chunk.data = static_cast<char *>(std::malloc(chunk.capacity));
+		
+		if(!chunk.data)
+			throw std::bad_alloc();
+	}
+	
+	chunk.size = 0;
+	
+	_chunks.push_back(chunk);
+	return _chunks.back();
+}
+
+void file_logging_engine::write_chunks()
+{
+	struct iovec vectors[__max_chunks];
+	
+	size_t index = 0;
+	size_t offset = 0; // Bytes of _chunks[index] that already got written
+	
+	while(_good && index < _chunks.size())
+	{
+		int count = 0;
+		
+		for(size_t i = index; i < _chunks.size() && count < static_cast<int>(__max_chunks); i ++, count ++)
+		{
+			size_t skip = (i == index) ? offset : 0;
+			
+			vectors[count].iov_base = _chunks[i].data + skip;
+			vectors[count].iov_len  = _chunks[i].size - skip;
+		}
+		
+		ssize_t result = ::writev(_fd, vectors, count);
+		
+		if(result < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			
+			_good = false;
+			break;
+		}
+		
+		_file_size += result;
+		_bytes_written.fetch_add(result, std::memory_order_relaxed);
+		
+		// Partial writes are possible, continue right where the write stopped
+		size_t written = static_cast<size_t>(result);
+		
+		while(written > 0 && index < _chunks.size())
+		{
+			size_t left = _chunks[index].size - offset;
+			
+			if(written < left)
+			{
+				offset += written;
+				break;
+			}
+			
+			written -= left;
+			offset = 0;
+			index ++;
+		}
+	}
+	
+	// Chunks are reused, except for oversized ones that were made for a single huge message
+	for(auto& chunk : _chunks)
+	{
+		if(chunk.capacity == _chunk_size)
+			_spare.push_back(chunk);
+		else
+			std::free(chunk.data);
+	}
+	
+	_chunks.clear();
+}
+
+
+
+void file_logging_engine::open_file()
+{
+	_fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	_good = (_fd >= 0);
+	_file_size = 0;
+	_opened = std::chrono::steady_clock::now();
+	
+	struct stat info;
+	if(_good && ::fstat(_fd, &info) == 0)
+		_file_size = static_cast<uint64_t>(info.st_size);
+}
+
+void file_logging_engine::close_file()
+{
+	if(_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+	
+	_good = false;
+}
+
+void file_logging_engine::rotate()
+{
+	close_file();
+	
+	size_t max_files = _max_files.load(std::memory_order_relaxed);
+	
+	if(max_files > 0)
+	{
+		// path.n-1 -> path.n, ..., path -> path.1, the oldest file falls off the end
+		for(size_t i = max_files; i > 1; i --)
+		{
+			std::string from = _path + "." + std::to_string(i - 1);
+			std::string to   = _path + "." + std::to_string(i);
+			
+			std::rename(from.c_str(), to.c_str());
+		}
+		
+		std::rename(_path.c_str(), (_path + ".1").c_str());
+	}
+	else
+	{
+		std::remove(_path.c_str());
+	}
+	
+	open_file();
+}
@@ -0,0 +1,87 @@
+//
+//  rkfileloggingengine.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_FILELOGGINGENGINE_H_
+#define _RATATOSKR_FILELOGGINGENGINE_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include "rkloggingengine.h"
+
+namespace ratatoskr
+{
+	// Writes straight to a file descriptor. Messages are collected in large chunks which get written
+	// with a single writev() per flush, rotation happens after a flush so it never holds up a write.
+	class file_logging_engine : public logging_engine
+	{
+	public:
+		file_logging_engine(const std::string& path, size_t chunk_size = 256 * 1024);
+		~file_logging_engine() override;
+		
+		void set_rotation_size(uint64_t bytes); // Rotates once the file exceeds the size, 0 (the default) disables it
+		void set_rotation_interval(std::chrono::seconds interval); // 0 (the default) disables it
+		void set_max_files(size_t count); // Rotated files that are kept around as path.1 to path.count, defaults to 5
+		
+		uint64_t get_bytes_written() const { return _bytes_written.load(std::memory_order_relaxed); }
+		
+		line_formatter& get_formatter() { return _formatter; }
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+	private:
+		struct chunk
+		{
+			char *data;
+			size_t size;
+			size_t capacity;
+		};
+		
+		chunk& acquire_chunk(size_t length);
+		void write_chunks();
+		
+		void open_file();
+		void close_file();
+		void rotate();
+		
+		std::string _path;
+		int _fd;
+		bool _good;
+		uint64_t _file_size;
+		std::chrono::steady_clock::time_point _opened;
+		
+		line_formatter _formatter;
+		
+		size_t _chunk_size;
+		std::vector<chunk> _chunks;
+		std::vector<chunk> _spare;
+		
+		std::atomic<uint64_t> _rotation_size;
+		std::atomic<int64_t> _rotation_interval;
+		std::atomic<size_t> _max_files;
+		std::atomic<uint64_t> _bytes_written;
+	};
+}
+
+#endif /* _RATATOSKR_FILELOGGINGENGINE_H_ */
@@ -0,0 +1,268 @@
+//
+//  rkformatter.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include "rkformatter.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	// Manipulators are applied to this stream to find out which flags they change, it's
+	// created once per thread so it doesn't cost anything in the steady state
+	std::ostream& get_manipulator_stream()
+	{
+		static thread_local std::ostringstream stream;
+		return stream;
+	}
+	
+	// Two digits per entry, decimal conversion does one division per two digits this way
+	const char __digit_pairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+	
+	// Writes val backwards into the end of the buffer and returns the start of the digits
+	char *write_digits(char *end, unsigned long long val, unsigned int base, bool uppercase)
+	{
+		if(base == 10)
+			return formatter::write_decimal(end, val);
+		
+		const char *digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+		
+		do {
+			*(-- end) = digits[val % base];
+			val /= base;
+		} while(val);
+		
+		return end;
+	}
+}
+
+char *formatter::write_decimal(char *end, unsigned long long val)
+{
+	while(val >= 100)
+	{
+		unsigned int pair = static_cast<unsigned int>(val % 100) * 2;
+		val /= 100;
+		
+		*(-- end) = __digit_pairs[pair + 1];
+		*(-- end) = __digit_pairs[pair];
+	}
+	
+	if(val >= 10)
+	{
+		unsigned int pair = static_cast<unsigned int>(val) * 2;
+		
+		*(-- end) = __digit_pairs[pair + 1];
+		*(-- end) = __digit_pairs[pair];
+	}
+	else
+	{
+		*(-- end) = static_cast<char>('0' + val);
+	}
+	
+	return end;
+}
+
+void formatter::write_decimal(char *output, unsigned int val, size_t width)
+{
+	char *end = output + width;
+	
+	while(end - output >= 2)
+	{
+		unsigned int pair = (val % 100) * 2;
+		val /= 100;
+		
+		*(-- end) = __digit_pairs[pair + 1];
+		*(-- end) = __digit_pairs[pair];
+	}
+	
+	if(end != output)
+		*(-- end) = static_cast<char>('0' + (val % 10));
+}
+
+void formatter::format(buffer& output, const char *val)
+{
+	if(val)
+		output.append(val, std::strlen(val));
+}
+
+void formatter::format(buffer& output, bool val)
+{
+	if(_flags & std::ios_base::boolalpha)
+	{
+		if(val)
+			output.append("true", 4);
+		else
+			output.append("false", 5);
+		
+		return;
+	}
+	
+	format_integer(output, val ? 1 : 0, false);
+}
+
+void formatter::format_integer(buffer& output, unsigned long long val, bool negative, bool positive)
+{
+	char scratch[32];
+	char *end = scratch + sizeof(scratch);
+	char *begin;
+	
+	bool uppercase = (_flags & std::ios_base::uppercase);
+	
+	switch(_flags & std::ios_base::basefield)
+	{
+		case std::ios_base::hex:
+			begin = write_digits(end, val, 16, uppercase);
+			
+			if((_flags & std::ios_base::showbase) && val != 0)
+			{
+				*(-- begin) = uppercase ? 'X' : 'x';
+				*(-- begin) = '0';
+			}
+			break;
+			
+		case std::ios_base::oct:
+			begin = write_digits(end, val, 8, false);
+			
+			if((_flags & std::ios_base::showbase) && val != 0)
+				*(-- begin) = '0';
+			break;
+			
+		default:
+			begin = write_digits(end, val, 10, false);
+			
+			if(negative)
+				*(-- begin) = '-';
+			else if(positive)
+				*(-- begin) = '+';
+			break;
+	}
+	
+	output.append(begin, end - begin);
+}
+
+void formatter::format(buffer& output, double val)
+{
+	char format[8];
+	char *specifier = format;
+	
+	*specifier ++ = '%';
+	
+	if(_flags & std::ios_base::showpos)
+		*specifier ++ = '+';
+	if(_flags & std::ios_base::showpoint)
+		*specifier ++ = '#';
+	
+	bool uppercase = (_flags & std::ios_base::uppercase);
+	bool hexfloat = ((_flags & std::ios_base::floatfield) == (std::ios_base::fixed | std::ios_base::scientific));
+	
+	// Hexfloat output ignores the precision, everything else uses the streams default of 6
+	if(!hexfloat)
+	{
+		*specifier ++ = '.';
+		*specifier ++ = '*';
+	}
+	
+	switch(_flags & std::ios_base::floatfield)
+	{
+		case std::ios_base::fixed:
+			*specifier ++ = uppercase ? 'F' : 'f';
+			break;
+		case std::ios_base::scientific:
+			*specifier ++ = uppercase ? 'E' : 'e';
+			break;
+		case std::ios_base::fixed | std::ios_base::scientific:
+			*specifier ++ = uppercase ? 'A' : 'a';
+			break;
+		default:
+			*specifier ++ = uppercase ? 'G' : 'g';
+			break;
+	}
+	
+	*specifier = '\0';
+	
+	// Large enough for any fixed point double at the default precision
+	char *scratch = output.reserve(384);
+	int length = hexfloat ? std::snprintf(scratch, 384, format, val) : std::snprintf(scratch, 384, format, 6, val);
+	
+	if(length > 0)
+		output.commit(static_cast<size_t>(length));
+}
+
+void formatter::format(buffer& output, const void *val)
+{
+	std::ios_base::fmtflags flags = _flags;
+	
+	_flags = std::ios_base::hex | std::ios_base::showbase;
+	
+	if(val)
+		format_integer(output, reinterpret_cast<uintptr_t>(val), false);
+	else
+		output.append("0x0", 3);
+	
+	_flags = flags;
+}
+
+void formatter::format(buffer& output, stream_manipulator val)
+{
+	if(val == static_cast<stream_manipulator>(std::endl))
+	{
+		output.push_back('\n');
+		return;
+	}
+	
+	if(val == static_cast<stream_manipulator>(std::ends))
+	{
+		output.push_back('\0');
+		return;
+	}
+	
+	// Anything else (ie. std::flush) has no effect on the text
+}
+
+void formatter::format(buffer&, ios_manipulator val)
+{
+	std::ostream& stream = get_manipulator_stream();
+	
+	stream.flags(_flags);
+	val(stream);
+	
+	_flags = stream.flags();
+}
+
+void formatter::format(buffer&, ios_base_manipulator val)
+{
+	std::ostream& stream = get_manipulator_stream();
+	
+	stream.flags(_flags);
+	val(stream);
+	
+	_flags = stream.flags();
+}
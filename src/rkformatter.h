@@ -0,0 +1,102 @@
+//
+//  rkformatter.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_FORMATTER_H_
+#define _RATATOSKR_FORMATTER_H_
+
+#include <ios>
+#include <ostream>
+#include <type_traits>
+#include "rkbuffer.h"
+
+namespace ratatoskr
+{
+	// Renders values to text the same way std::ostream does, but straight into a buffer without
+	// touching the locale or allocating. Manipulators like std::hex or std::boolalpha are supported.
+	class formatter
+	{
+	public:
+		typedef std::ostream& (*stream_manipulator)(std::ostream&);
+		typedef std::ios& (*ios_manipulator)(std::ios&);
+		typedef std::ios_base& (*ios_base_manipulator)(std::ios_base&);
+		
+		formatter() :
+			_flags(std::ios_base::dec | std::ios_base::skipws)
+		{}
+		
+		void reset() { _flags = std::ios_base::dec | std::ios_base::skipws; }
+		
+		void format(buffer& output, const char *val, size_t length) { output.append(val, length); }
+		void format(buffer& output, const char *val);
+		void format(buffer& output, char val) { output.push_back(val); }
+		void format(buffer& output, bool val);
+		void format(buffer& output, short val) { format_signed(output, val); }
+		void format(buffer& output, unsigned short val) { format_unsigned(output, val); }
+		void format(buffer& output, int val) { format_signed(output, val); }
+		void format(buffer& output, unsigned int val) { format_unsigned(output, val); }
+		void format(buffer& output, long val) { format_signed(output, val); }
+		void format(buffer& output, unsigned long val) { format_unsigned(output, val); }
+		void format(buffer& output, long long val) { format_signed(output, val); }
+		void format(buffer& output, unsigned long long val) { format_unsigned(output, val); }
+		void format(buffer& output, double val);
+		void format(buffer& output, const void *val);
+		
+		void format(buffer& output, stream_manipulator val);
+		void format(buffer& output, ios_manipulator val);
+		void format(buffer& output, ios_base_manipulator val);
+		
+		// Writes the digits of val backwards, ending right before end, and returns the first digit. Needs up to 20 bytes
+		static char *write_decimal(char *end, unsigned long long val);
+		// Writes val as exactly width digits, zero padded from the left
+		static void write_decimal(char *output, unsigned int val, size_t width);
+		
+	private:
+		template<class T>
+		void format_signed(buffer& output, T val)
+		{
+			typedef typename std::make_unsigned<T>::type unsigned_type;
+			
+			// Like std::ostream, octal and hexadecimal output print the two's complement of negative values
+			if((_flags & std::ios_base::basefield) == std::ios_base::oct || (_flags & std::ios_base::basefield) == std::ios_base::hex)
+			{
+				format_integer(output, static_cast<unsigned_type>(val), false);
+				return;
+			}
+			
+			if(val < 0)
+			{
+				format_integer(output, static_cast<unsigned long long>(0) - static_cast<unsigned long long>(static_cast<long long>(val)), true);
+				return;
+			}
+			
+			format_integer(output, static_cast<unsigned long long>(val), false, (_flags & std::ios_base::showpos));
+		}
+		
+		template<class T>
+		void format_unsigned(buffer& output, T val)
+		{
+			format_integer(output, static_cast<unsigned long long>(val), false);
+		}
+		
+		void format_integer(buffer& output, unsigned long long val, bool negative, bool positive = false);
+		
+		std::ios_base::fmtflags _flags;
+	};
+}
+
+#endif /* _RATATOSKR_FORMATTER_H_ */
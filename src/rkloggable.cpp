@@ -20,10 +20,6 @@
 
 using namespace ratatoskr;
 
-loggable::loggable(log_level level) :
-	_level(level)
-{}
-
 loggable::~loggable()
 {
 	submit();
@@ -31,12 +27,15 @@ loggable::~loggable()
 
 void loggable::submit()
 {
-	std::string string = std::move(_stream.str());
-	_stream.str(std::string());
+	if(!_enabled || _record.empty())
+		return;
+	
+	// The record lives inside the loggable and is moved into the message, so unless the message
+	// outgrows the records inline storage this doesn't allocate
+	message message(_level, std::move(_record), message::deferred_time());
+	
+	_record.clear();
+	_formatter.reset();
 	
-	if(!string.empty())
-	{
-		message message(_level, std::move(string));
-		logger::get_shared_instance()->log(std::move(message));
-	}
+	_logger->log(std::move(message));
 }
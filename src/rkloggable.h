@@ -19,38 +19,104 @@
 #ifndef _RATATOSKR_LOGGABLE_H_
 #define _RATATOSKR_LOGGABLE_H_
 
-#include <sstream>
 #include "rklogger.h"
+#include "rkrecord.h"
 
 namespace ratatoskr
 {
+	enum class format_mode
+	{
+		immediate, // Arguments are rendered to text on the calling thread
+		deferred // Arguments are stored in binary form and rendered on the flush thread
+	};
+	
+	// Typed key/value pair which gets attached to the record as a field rather than formatted into the message
+	template<class T>
+	struct key_value
+	{
+		const char *key;
+		const T& value;
+	};
+	
+	// ie. loggable() << "Request done" << field("status", 200) << field("path", path);
+	template<class T>
+	key_value<T> field(const char *key, const T& value) { return key_value<T>{ key, value }; }
+	
 	class loggable
 	{
 	public:
-		loggable(log_level level = log_level::info);
+		loggable(log_level level = log_level::info, format_mode mode = format_mode::immediate) :
+			loggable(*logger::get_shared_instance(), level, mode)
+		{}
+		loggable(logger& target, log_level level = log_level::info, format_mode mode = format_mode::immediate) :
+			_logger(&target),
+			_level(level),
+			_mode(mode),
+			_enabled(static_cast<int>(level) >= RATATOSKR_MIN_LOG_LEVEL && target.is_enabled(level))
+		{}
+		
 		~loggable();
 		
 		void submit();
 		
-		loggable& operator << (const std::string& val) { _stream << val; return *this; }
-		loggable& operator << (const char *val) { _stream << val; return *this; }
-		loggable& operator << (bool val) { _stream << val; return *this; }
-		loggable& operator << (short val) { _stream << val; return *this; }
-		loggable& operator << (unsigned short val) { _stream << val; return *this; }
-		loggable& operator << (int val) { _stream << val; return *this; }
-		loggable& operator << (unsigned int val) { _stream << val; return *this; }
-		loggable& operator << (long val) { _stream << val; return *this; }
-		loggable& operator << (unsigned long val) { _stream << val; return *this; }
-		loggable& operator << (long long val) { _stream << val; return *this; }
-		loggable& operator << (unsigned long long val) { _stream << val; return *this; }
-		loggable& operator << (const void *val) { _stream << val; return *this; }
-		loggable& operator << (std::ostream& (*pf)(std::ostream&)) { _stream << pf; return *this; }
-		loggable& operator << (std::ios& (*pf)(std::ios&)) { _stream << pf; return *this; };
-		loggable& operator << (std::ios_base& (*pf)(std::ios_base&)) { _stream << pf; return *this; }
+		loggable& operator << (const std::string& val) { append(val); return *this; }
+		loggable& operator << (const char *val) { append(val); return *this; }
+		loggable& operator << (char val) { append(val); return *this; }
+		loggable& operator << (bool val) { append(val); return *this; }
+		loggable& operator << (short val) { append(val); return *this; }
+		loggable& operator << (unsigned short val) { append(val); return *this; }
+		loggable& operator << (int val) { append(val); return *this; }
+		loggable& operator << (unsigned int val) { append(val); return *this; }
+		loggable& operator << (long val) { append(val); return *this; }
+		loggable& operator << (unsigned long val) { append(val); return *this; }
+		loggable& operator << (long long val) { append(val); return *this; }
+		loggable& operator << (unsigned long long val) { append(val); return *this; }
+		loggable& operator << (float val) { append(val); return *this; }
+		loggable& operator << (double val) { append(val); return *this; }
+		loggable& operator << (const void *val) { append(val); return *this; }
+		loggable& operator << (std::ostream& (*pf)(std::ostream&)) { append(pf); return *this; }
+		loggable& operator << (std::ios& (*pf)(std::ios&)) { append(pf); return *this; };
+		loggable& operator << (std::ios_base& (*pf)(std::ios_base&)) { append(pf); return *this; }
+		
+		template<class T>
+		loggable& operator << (const key_value<T>& val)
+		{
+			if(_enabled)
+				_record.add_field(val.key, val.value);
+			
+			return *this;
+		}
 		
 	private:
+		template<class T>
+		void append(T val)
+		{
+			if(!_enabled)
+				return;
+			
+			if(_mode == format_mode::deferred)
+				_record.append(val);
+			else
+				_formatter.format(_record.text(), val);
+		}
+		
+		void append(const std::string& val)
+		{
+			if(!_enabled)
+				return;
+			
+			if(_mode == format_mode::deferred)
+				_record.append(val);
+			else
+				_record.text().append(val.data(), val.size());
+		}
+		
+		logger *_logger;
 		log_level _level;
-		std::stringstream _stream;
+		format_mode _mode;
+		bool _enabled;
+		formatter _formatter;
+		record _record;
 	};
 }
 
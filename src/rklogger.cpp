@@ -16,13 +16,376 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <unistd.h>
 #include "rklogger.h"
 #include "rkloggingengine.h"
+#include "rkcrashhandler.h"
+#include "rkringbuffer.h"
 
 using namespace ratatoskr;
 
-// Used as fallback when there is no engine registered with the logger
-static stream_logging_engine __fallback_engine(std::cout);
+// Every logger gets a unique id, which is used to look up the calling threads producer
+static std::atomic<uint64_t> __logger_id(0);
+
+namespace
+{
+	// Helpers of emergency_flush(), which runs in signal handlers
+	template<class T>
+	bool try_lock_briefly(T& lock)
+	{
+		for(size_t i = 0; i < 1000; i ++)
+		{
+			if(lock.try_lock())
+				return true;
+			
+			detail::cpu_relax();
+		}
+		
+		return false;
+	}
+	
+	void write_all(int fd, const char *data, size_t length)
+	{
+		while(length > 0)
+		{
+			ssize_t result = ::write(fd, data, length);
+			
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				
+				return;
+			}
+			
+			data += result;
+			length -= static_cast<size_t>(result);
+		}
+	}
+	
+	// Longer messages are cut off
+	const size_t emergency_line_length = 2048;
+	const size_t emergency_output_length = 4 * emergency_line_length;
+	
+	void append_emergency_line(int fd, char *output, size_t& size, const message& message)
+	{
+		if(size + emergency_line_length > emergency_output_length)
+		{
+			write_all(fd, output, size);
+			size = 0;
+		}
+		
+		char *data = output + size;
+		size_t length;
+		
+		const char *level = logging_engine::translate_log_level(message.get_level(), length);
+		
+		std::memcpy(data, level, length);
+		data[length] = ' ';
+		data += length + 1;
+		
+		size_t capacity = emergency_line_length - length - 2;
+		
+		// Messages created from a string hold it as a text record, so this never needs get_message(), which allocates
+		length = message.get_record().render_emergency(data, capacity);
+		
+		data += length;
+		*data ++ = '\n';
+		
+		size = static_cast<size_t>(data - output);
+	}
+}
+
+// ---------------------
+// MARK: -
+// MARK: producer
+// ---------------------
+
+namespace
+{
+	// Latency trace of one thread. The histogram is only written by the thread itself,
+	// the call sites are guarded by the lock, which is only taken for outliers and reports
+	struct producer_trace
+	{
+		histogram_recorder calls;
+		spinlock lock;
+		std::vector<call_site_latency> sites;
+	};
+	
+	void merge_site(std::vector<call_site_latency>& sites, const call_site_latency& site)
+	{
+		for(auto& entry : sites)
+		{
+			if(entry.descriptor_id == site.descriptor_id)
+			{
+				entry.outliers += site.outliers;
+				entry.total += site.total;
+				entry.max = std::max(entry.max, site.max);
+				
+				for(size_t i = 0; i <= static_cast<size_t>(stall_cause::blocked); i ++)
+					entry.causes[i] += site.causes[i];
+				
+				return;
+			}
+		}
+		
+		sites.push_back(site);
+	}
+}
+
+class logger::producer
+{
+public:
+	producer(size_t capacity) :
+		queue(capacity),
+		orphaned(false),
+		closed(false),
+		overflowed(0),
+		blocked(0),
+		lock_contentions(0),
+		lock_wait(0),
+		threshold_triggers(0),
+		trace(nullptr)
+	{}
+	
+	~producer()
+	{
+		delete trace.load();
+	}
+	
+	// Counters are only written by the owning thread, so they don't need read-modify-write atomics
+	static void increment(std::atomic<uint64_t>& counter, uint64_t value = 1)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+	
+	void add_counters(producer_counters& counters) const
+	{
+		counters.overflowed += overflowed.load(std::memory_order_relaxed);
+		counters.blocked += blocked.load(std::memory_order_relaxed);
+		counters.lock_contentions += lock_contentions.load(std::memory_order_relaxed);
+		counters.lock_wait += lock_wait.load(std::memory_order_relaxed);
+		counters.threshold_triggers += threshold_triggers.load(std::memory_order_relaxed);
+	}
+	
+	ringbuffer<message> queue;
+	std::atomic<bool> orphaned; // Set once the owning thread has exited
+	std::atomic<bool> closed; // Set once the logger is gone, so threads can drop their cache entry
+	
+	std::atomic<uint64_t> overflowed;
+	std::atomic<uint64_t> blocked;
+	std::atomic<uint64_t> lock_contentions;
+	std::atomic<uint64_t> lock_wait; // Nanoseconds
+	std::atomic<uint64_t> threshold_triggers;
+	
+	std::atomic<producer_trace *> trace; // Created by the owning thread on its first traced call
+};
+
+namespace
+{
+	// Times one log() call and the steps known to stall it. Inactive traces, ie. while tracing is off, cost a branch per step
+	class call_trace
+	{
+	public:
+		call_trace(bool active, uint64_t threshold, uint32_t descriptor) :
+			_active(active),
+			_threshold(threshold),
+			_descriptor(descriptor),
+			_producer(nullptr),
+			_phases()
+		{
+			if(_active)
+				_start = std::chrono::steady_clock::now();
+		}
+		
+		~call_trace()
+		{
+			if(_active && _producer)
+				finish();
+		}
+		
+		void attach(logger::producer *producer) { _producer = producer; }
+		
+		void begin()
+		{
+			if(_active)
+				_phase_start = std::chrono::steady_clock::now();
+		}
+		
+		void end(stall_cause cause)
+		{
+			if(_active)
+				add(cause, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _phase_start).count());
+		}
+		
+		void add(stall_cause cause, uint64_t duration)
+		{
+			if(_active)
+				_phases[static_cast<size_t>(cause)] += duration;
+		}
+		
+	private:
+		void finish()
+		{
+			uint64_t total = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+			producer_trace *trace = _producer->trace.load(std::memory_order_acquire);
+			
+			if(!trace)
+			{
+				trace = new producer_trace();
+				_producer->trace.store(trace, std::memory_order_release);
+			}
+			
+			trace->calls.record(total);
+			
+			if(total < _threshold)
+				return;
+			
+			size_t cause = static_cast<size_t>(stall_cause::other);
+			
+			for(size_t i = 1; i <= static_cast<size_t>(stall_cause::blocked); i ++)
+			{
+				if(_phases[i] > _phases[cause])
+					cause = i;
+			}
+			
+			if(_phases[cause] * 2 < total)
+				cause = static_cast<size_t>(stall_cause::other);
+			
+			call_site_latency site = { _descriptor, nullptr, 1, total, total, {} };
+			site.causes[cause] = 1;
+			
+			std::lock_guard<spinlock> lock(trace->lock);
+			merge_site(trace->sites, site);
+		}
+		
+		bool _active;
+		uint64_t _threshold;
+		uint32_t _descriptor;
+		logger::producer *_producer;
+		
+		std::chrono::steady_clock::time_point _start;
+		std::chrono::steady_clock::time_point _phase_start;
+		uint64_t _phases[static_cast<size_t>(stall_cause::blocked) + 1];
+	};
+}
+
+// ---------------------
+// MARK: -
+// MARK: engine_worker
+// ---------------------
+
+class logger::engine_worker
+{
+public:
+	engine_worker(logging_engine *engine, const std::shared_ptr<histogram_recorder>& write_time) :
+		engine(engine),
+		write_time(write_time),
+		messages(0),
+		dropped(0),
+		stopping(false),
+		thread(std::bind(&engine_worker::run, this))
+	{}
+	
+	~engine_worker()
+	{
+		stop();
+	}
+	
+	// Returns once all queued batches are written
+	void stop()
+	{
+		{
+			std::lock_guard<decltype(lock)> guard(lock);
+			stopping = true;
+		}
+		
+		signal.notify_one();
+		
+		if(thread.joinable())
+			thread.join();
+	}
+	
+	void push(const std::shared_ptr<flush_data>& batch, size_t max_backlog)
+	{
+		std::lock_guard<decltype(lock)> guard(lock);
+		
+		// Rather miss messages in a slow engine than hold up the flush thread and with it every other engine
+		if(!queue.empty() && messages + batch->buffer.size() > max_backlog)
+		{
+			dropped += batch->buffer.size();
+			return;
+		}
+		
+		messages += batch->buffer.size();
+		queue.push_back(batch);
+		
+		signal.notify_one();
+	}
+	
+	engine_backlog get_backlog()
+	{
+		std::lock_guard<decltype(lock)> guard(lock);
+		return { queue.size(), messages, dropped };
+	}
+	
+	logging_engine *engine;
+	std::shared_ptr<histogram_recorder> write_time;
+	
+private:
+	void run()
+	{
+		std::unique_lock<decltype(lock)> guard(lock);
+		
+		while(1)
+		{
+			signal.wait(guard, [this]{ return (stopping || !queue.empty()); });
+			
+			// Queued batches are still written when stopping
+			if(queue.empty())
+				break;
+			
+			const flush_data *batch = queue.front().get();
+			
+			guard.unlock();
+			flush_engine(engine, *batch, write_time.get());
+			guard.lock();
+			
+			messages -= batch->buffer.size();
+			queue.pop_front();
+		}
+	}
+	
+	std::mutex lock;
+	std::condition_variable signal;
+	std::deque<std::shared_ptr<const flush_data>> queue;
+	size_t messages;
+	uint64_t dropped;
+	bool stopping;
+	
+	std::thread thread;
+};
+
+namespace
+{
+	struct producer_cache
+	{
+		~producer_cache()
+		{
+			for(auto& entry : entries)
+				entry.second->orphaned.store(true, std::memory_order_release);
+		}
+		
+		std::vector<std::pair<uint64_t, std::shared_ptr<logger::producer>>> entries;
+	};
+	
+	thread_local producer_cache __producer_cache;
+	thread_local bool __flushing = false; // Set while the thread is in force_flush(), it must never block on the overflow buffer
+}
 
 // ---------------------
 // MARK: -
@@ -31,20 +394,123 @@ static stream_logging_engine __fallback_engine(std::cout);
 
 message::message(log_level level, const std::string& message) :
 	_level(level),
-	_time(std::chrono::system_clock::now()),
-	_message(message)
-{}
+	_clock(clock_source::system),
+	_sequence(0),
+	_stamp(0),
+	_time(std::chrono::system_clock::now())
+{
+	_record.text().append(message.data(), message.size());
+}
 
 message::message(log_level level, std::string&& message) :
 	_level(level),
+	_clock(clock_source::system),
+	_sequence(0),
+	_stamp(0),
+	_time(std::chrono::system_clock::now())
+{
+	_record.text().append(message.data(), message.size());
+}
+
+message::message(log_level level, record&& record) :
+	_level(level),
+	_clock(clock_source::system),
+	_sequence(0),
+	_stamp(0),
 	_time(std::chrono::system_clock::now()),
-	_message(std::move(message))
+	_record(std::move(record))
+{}
+
+message::message(log_level level, record&& record, deferred_time) :
+	_level(level),
+	_clock(clock_source::system),
+	_sequence(0),
+	_stamp(0),
+	_record(std::move(record))
 {}
 
 
 const std::string& message::get_message() const
 {
-	return _message;
+	std::shared_ptr<const std::string> text = std::atomic_load(&_message);
+	
+	if(!text)
+	{
+		std::shared_ptr<const std::string> result;
+		
+		if(_rendered.data)
+		{
+			result = std::make_shared<const std::string>(_rendered.data, _rendered.length);
+		}
+		else
+		{
+			small_buffer<512> output;
+			_record.render(output);
+			
+			result = std::make_shared<const std::string>(output.data(), output.size());
+		}
+		
+		// Engines on worker threads can get here at the same time, all of them end up with the string that got published first
+		if(std::atomic_compare_exchange_strong(&_message, &text, result))
+			text = result;
+	}
+	
+	return *text;
+}
+
+size_t message::get_message_length() const
+{
+	if(_rendered.data)
+		return _rendered.message_length;
+	
+	if(_record.is_text())
+		return _record.text().size();
+	
+	small_buffer<512> output;
+	_record.render_message(output);
+	
+	return output.size();
+}
+
+const char *message::get_text() const
+{
+	if(_rendered.data)
+		return _rendered.data;
+	
+	if(_record.is_text() && !_record.has_fields())
+		return _record.text().data();
+	
+	return get_message().data();
+}
+
+size_t message::get_length() const
+{
+	if(_rendered.data)
+		return _rendered.length;
+	
+	if(_record.is_text() && !_record.has_fields())
+		return _record.text().size();
+	
+	return get_message().size();
+}
+
+void message::prepare(arena& arena, buffer& scratch)
+{
+	// Text records and plain strings can be used as they are, unless they carry fields which need to be appended
+	if(_record.empty() || (_record.is_text() && !_record.has_fields()) || _rendered.data)
+		return;
+	
+	scratch.clear();
+	
+	_record.render_message(scratch);
+	_rendered.message_length = static_cast<uint32_t>(scratch.size());
+	_record.render_fields(scratch);
+	
+	char *data = arena.allocate(scratch.size());
+	std::memcpy(data, scratch.data(), scratch.size());
+	
+	_rendered.data = data;
+	_rendered.length = static_cast<uint32_t>(scratch.size());
 }
 
 // ---------------------
@@ -53,16 +519,49 @@ const std::string& message::get_message() const
 // ---------------------
 
 logger::logger() :
+	_id(__logger_id.fetch_add(1)),
+	_sequence(0),
+	_teardown_flag(false),
+	_overflow_drained(0),
+	_max_overflow(1048576),
+	_overflow_policy(overflow_policy::block),
+	_drop_level(log_level::warning),
+	_dropped(0),
+	_reported_dropped(0),
+	_max_overflow_depth(0),
 	_last_message(std::chrono::system_clock::now()),
+	_engine_list(std::make_shared<engine_list>()),
+	_fallback_engine(new stream_logging_engine(std::cout)),
+	_flushes_started(0),
+	_flushes_finished(0),
+	_max_backlog(65536),
+	_threshold(static_cast<int>(log_level::info)), // Level of the fallback engine
 	_significant_time(10),
-	_teardown_flag(false),
+	_retired_counters(),
+	_tracing(false),
+	_outlier_threshold(50000),
+	_active_producers(1),
+	_producer_capacity(1024),
+	_clock_source(clock_source::system),
 	_flush_delay(250),
-	_flush_buffer_threshold(1024),
+	_fixed_delay(false),
+	_flush_buffer_threshold(256),
+	_fixed_threshold(false),
+	_timed_flushes(0),
+	_requested_flushes(0),
+	_telemetry_interval(0),
+	_last_telemetry(std::chrono::steady_clock::now()),
+	_next_sequence(0),
+	_gap_sequence(UINT64_MAX),
 	_flush_thread(std::thread(std::bind(&logger::flush_run_loop, this)))
-{}
+{
+	_flush_flag.clear();
+}
 
 logger::~logger()
 {
+	crash_handler::unwatch(this);
+	
 	_teardown_flag.store(true);
 	_signal.notify_one();
 	
@@ -77,22 +576,60 @@ logger::~logger()
 	
 	force_flush();
 	
-	for(auto engine : _engines)
-		engine->finalize();
+	std::shared_ptr<const engine_list> engines = std::atomic_load(&_engine_list);
+	std::atomic_store(&_engine_list, std::shared_ptr<const engine_list>(std::make_shared<engine_list>()));
+	
+	for(size_t i = 0; i < engines->engines.size(); i ++)
+	{
+		// Waits for the worker to write its remaining batches
+		if(engines->workers[i])
+			engines->workers[i]->stop();
+		
+		engines->engines[i]->detach(this);
+		engines->engines[i]->finalize();
+	}
+	
+	std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+	
+	for(auto& producer : _producers)
+		producer->closed.store(true, std::memory_order_release);
 }
 
 
 
+void logger::set_flush_targets(std::chrono::milliseconds latency, size_t throughput)
+{
+	{
+		std::lock_guard<decltype(_signal_lock)> lock(_signal_lock);
+		
+		_scheduler.set_targets(latency, throughput);
+		_fixed_delay = false;
+	}
+	
+	_fixed_threshold.store(false, std::memory_order_relaxed);
+	_signal.notify_one();
+}
+
 void logger::set_flush_delay(size_t delay)
 {
 	std::lock_guard<decltype(_signal_lock)> lock(_signal_lock);
+	
 	_flush_delay = delay;
+	_fixed_delay = true;
 }
 
 void logger::set_flush_buffer_threshold(size_t threshold)
 {
-	std::lock_guard<decltype(_lock)> lock(_lock);
-	_flush_buffer_threshold = threshold;
+	_fixed_threshold.store(true, std::memory_order_relaxed);
+	_flush_buffer_threshold.store(threshold, std::memory_order_relaxed);
+}
+
+std::chrono::microseconds logger::get_flush_interval() const
+{
+	if(_fixed_delay.load())
+		return std::chrono::milliseconds(_flush_delay.load());
+	
+	return _scheduler.get_interval();
 }
 
 void logger::set_significant_time(size_t time)
@@ -101,60 +638,456 @@ void logger::set_significant_time(size_t time)
 	_significant_time = time;
 }
 
+void logger::set_producer_capacity(size_t capacity)
+{
+	_producer_capacity.store(std::max(capacity, static_cast<size_t>(1)), std::memory_order_relaxed);
+}
+
+void logger::set_clock_source(clock_source source)
+{
+	_clock_source.store(source, std::memory_order_relaxed);
+}
 
+void logger::set_max_backlog(size_t messages)
+{
+	_max_backlog.store(messages, std::memory_order_relaxed);
+}
 
-void logger::log(const message& message)
+void logger::set_overflow_policy(overflow_policy policy, log_level level)
 {
 	std::lock_guard<decltype(_lock)> lock(_lock);
-	_buffer.push_back(message);
 	
-	if(_buffer.size() >= _flush_buffer_threshold)
-		flush();
+	_overflow_policy = policy;
+	_drop_level = level;
 }
 
-void logger::log(message&& message)
+void logger::set_max_overflow(size_t messages)
 {
 	std::lock_guard<decltype(_lock)> lock(_lock);
-	_buffer.push_back(std::move(message));
+	_max_overflow = std::max(messages, static_cast<size_t>(1));
+}
+
+
+
+logger::producer *logger::get_producer()
+{
+	auto& entries = __producer_cache.entries;
+	
+	for(auto& entry : entries)
+	{
+		if(entry.first == _id)
+			return entry.second.get();
+	}
+	
+	// First message from this thread to this logger, register a new queue for it. Entries
+	// of loggers that were destroyed in the meantime are dropped on the way
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [](const std::pair<uint64_t, std::shared_ptr<producer>>& entry) { return entry.second->closed.load(std::memory_order_acquire); }), entries.end());
 	
-	if(_buffer.size() >= _flush_buffer_threshold)
+	std::shared_ptr<producer> result = std::make_shared<producer>(_producer_capacity.load(std::memory_order_relaxed));
+	
+	{
+		std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+		_producers.push_back(result);
+	}
+	
+	entries.emplace_back(_id, result);
+	return result.get();
+}
+
+void logger::log(const message& tmessage)
+{
+	if(!is_enabled(tmessage.get_level()))
+		return;
+	
+	message message(tmessage);
+	log(std::move(message));
+}
+
+void logger::log(message&& message)
+{
+	if(!is_enabled(message.get_level()))
+		return;
+	
+	call_trace trace(_tracing.load(std::memory_order_relaxed), _outlier_threshold.load(std::memory_order_relaxed), message.get_record().get_descriptor());
+	
+	trace.begin();
+	producer *producer = get_producer();
+	trace.end(stall_cause::registration);
+	trace.attach(producer);
+	
+	message._clock = _clock_source.load(std::memory_order_relaxed);
+	message._stamp = timekeeper::stamp(message._clock);
+	
+	while(1)
+	{
+		if(!producer->queue.full())
+		{
+			message._sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+			producer->queue.push(std::move(message));
+			
+			if(producer->queue.size() >= _flush_buffer_threshold.load(std::memory_order_relaxed))
+			{
+				producer::increment(producer->threshold_triggers);
+				
+				trace.begin();
+				flush();
+				trace.end(stall_cause::signal);
+			}
+			
+			return;
+		}
+		
+		// The threads queue is full, fall back to the shared buffer until the next flush
+		std::unique_lock<decltype(_lock)> lock(_lock, std::try_to_lock);
+		
+		if(!lock.owns_lock())
+		{
+			auto start = std::chrono::steady_clock::now();
+			lock.lock();
+			
+			uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			
+			producer::increment(producer->lock_contentions);
+			producer::increment(producer->lock_wait, wait);
+			trace.add(stall_cause::lock_wait, wait);
+		}
+		
+		if(_buffer.size() >= _max_overflow)
+		{
+			switch(_overflow_policy)
+			{
+				case overflow_policy::block:
+					if(__flushing)
+					{
+						_dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					
+					lock.unlock();
+					
+					trace.begin();
+					flush();
+					trace.end(stall_cause::signal);
+					
+					producer::increment(producer->blocked);
+					
+					{
+						// Woken up by the next drain, the timeout covers a drain that happened in between
+						trace.begin();
+						
+						std::unique_lock<decltype(_space_lock)> space_lock(_space_lock);
+						_space_signal.wait_for(space_lock, std::chrono::milliseconds(10));
+						
+						trace.end(stall_cause::blocked);
+					}
+					
+					continue;
+					
+				case overflow_policy::drop_newest:
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+					
+				case overflow_policy::drop_oldest:
+					// The flush thread needs to know that the sequence isn't going to show up
+					trace.begin();
+					_dropped_buffer.push_back(_buffer.front().get_sequence());
+					trace.end(stall_cause::allocation);
+					_buffer.pop_front();
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					break;
+					
+				case overflow_policy::drop_below_level:
+					if(message.get_level() < _drop_level)
+					{
+						_dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					
+					break;
+			}
+		}
+		
+		message._sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+		
+		trace.begin();
+		_buffer.push_back(std::move(message));
+		trace.end(stall_cause::allocation);
+		
+		_max_overflow_depth = std::max(_max_overflow_depth, _buffer.size());
+		
+		producer::increment(producer->overflowed);
+		
+		trace.begin();
 		flush();
+		trace.end(stall_cause::signal);
+		
+		return;
+	}
 }
 
 void logger::log(log_level level, const std::string& tmessage)
 {
-	message message(level, tmessage);
-	log(std::move(message));
+	if(!is_enabled(level))
+		return;
+	
+	record record;
+	record.text().append(tmessage.data(), tmessage.size());
+	
+	log(message(level, std::move(record), message::deferred_time()));
 }
 
 void logger::log(log_level level, std::string&& tmessage)
 {
-	message message(level, std::move(tmessage));
-	log(std::move(message));
+	if(!is_enabled(level))
+		return;
+	
+	record record;
+	record.text().append(tmessage.data(), tmessage.size());
+	
+	log(message(level, std::move(record), message::deferred_time()));
 }
 
 
 
-void logger::add_logging_engine(logging_engine *engine)
+bool logger::add_logging_engine(logging_engine *engine, dispatch_mode mode)
 {
-	std::lock_guard<decltype(_flush_lock)> lock(_flush_lock);
-	_engines.push_back(engine);
+	if(!engine->attach(this))
+		return false;
+	
+	{
+		std::lock_guard<decltype(_engine_lock)> lock(_engine_lock);
+		
+		std::shared_ptr<engine_list> list = std::make_shared<engine_list>(*std::atomic_load(&_engine_list));
+		
+		std::shared_ptr<histogram_recorder> write_time = std::make_shared<histogram_recorder>();
+		
+		list->engines.push_back(engine);
+		list->workers.push_back((mode == dispatch_mode::asynchronous) ? std::make_shared<engine_worker>(engine, write_time) : nullptr);
+		list->write_times.push_back(write_time);
+		
+		std::atomic_store(&_engine_list, std::shared_ptr<const engine_list>(std::move(list)));
+	}
+	
+	update_threshold();
+	return true;
 }
 
 void logger::remove_logging_engine(logging_engine *engine)
 {
-	std::lock_guard<decltype(_flush_lock)> lock(_flush_lock);
-	_engines.erase(std::remove(_engines.begin(), _engines.end(), engine), _engines.end());
+	std::shared_ptr<engine_worker> worker;
+	uint64_t retired;
+	
+	{
+		std::lock_guard<decltype(_engine_lock)> lock(_engine_lock);
+		
+		std::shared_ptr<const engine_list> current = std::atomic_load(&_engine_list);
+		
+		auto iterator = std::find(current->engines.begin(), current->engines.end(), engine);
+		if(iterator == current->engines.end())
+			return;
+		
+		size_t index = iterator - current->engines.begin();
+		std::shared_ptr<engine_list> list = std::make_shared<engine_list>(*current);
+		
+		worker = list->workers[index];
+		
+		list->engines.erase(list->engines.begin() + index);
+		list->workers.erase(list->workers.begin() + index);
+		list->write_times.erase(list->write_times.begin() + index);
+		
+		std::atomic_store(&_engine_list, std::shared_ptr<const engine_list>(std::move(list)));
+		
+		// Flushes that start from here on see the new list
+		retired = _flushes_started.load();
+	}
+	
+	engine->detach(this);
+	update_threshold();
+	
+	// A flush that started before the list was swapped might still be writing to the engine
+	{
+		std::unique_lock<decltype(_retire_lock)> lock(_retire_lock);
+		
+		while(_flushes_finished.load() < retired)
+			_retire_signal.wait_for(lock, std::chrono::milliseconds(1));
+	}
+	
+	// Lets the worker write what it has queued up before the engine gets finalized
+	if(worker)
+		worker->stop();
 	
 	engine->finalize();
 }
 
-std::vector<logging_engine *> logger::get_logging_engines()
+void logger::update_threshold()
 {
-	std::lock_guard<decltype(_flush_lock)> lock(_flush_lock);
-	std::vector<logging_engine *> engines(_engines);
+	std::lock_guard<decltype(_engine_lock)> lock(_engine_lock);
+	std::shared_ptr<const engine_list> engines = std::atomic_load(&_engine_list);
+	
+	int threshold = static_cast<int>(_fallback_engine->get_log_level());
+	
+	if(!engines->engines.empty())
+	{
+		threshold = static_cast<int>(log_level::critical);
+		
+		for(auto engine : engines->engines)
+			threshold = std::min(threshold, static_cast<int>(engine->get_log_level()));
+	}
 	
-	return engines;
+	_threshold.store(threshold, std::memory_order_relaxed);
+}
+
+std::vector<logging_engine *> logger::get_logging_engines() const
+{
+	return std::atomic_load(&_engine_list)->engines;
+}
+
+engine_backlog logger::get_backlog(logging_engine *engine) const
+{
+	std::shared_ptr<const engine_list> engines = std::atomic_load(&_engine_list);
+	
+	for(auto& worker : engines->workers)
+	{
+		if(worker && worker->engine == engine)
+			return worker->get_backlog();
+	}
+	
+	return { 0, 0, 0 };
+}
+
+logger_telemetry logger::get_telemetry() const
+{
+	logger_telemetry telemetry;
+	producer_counters counters;
+	
+	{
+		std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+		
+		counters = _retired_counters;
+		telemetry.queued = 0;
+		
+		for(auto& producer : _producers)
+		{
+			producer->add_counters(counters);
+			telemetry.queued += producer->queue.size();
+		}
+	}
+	
+	{
+		std::lock_guard<decltype(_lock)> lock(_lock);
+		
+		telemetry.overflow_depth = _buffer.size();
+		telemetry.max_overflow_depth = _max_overflow_depth;
+	}
+	
+	telemetry.messages = _sequence.load(std::memory_order_relaxed);
+	telemetry.dropped = _dropped.load(std::memory_order_relaxed);
+	telemetry.overflowed = counters.overflowed;
+	telemetry.blocked = counters.blocked;
+	telemetry.lock_contentions = counters.lock_contentions;
+	telemetry.lock_wait = counters.lock_wait;
+	telemetry.threshold_triggers = counters.threshold_triggers;
+	
+	telemetry.timed_flushes = _timed_flushes.load(std::memory_order_relaxed);
+	telemetry.requested_flushes = _requested_flushes.load(std::memory_order_relaxed);
+	
+	telemetry.latency = _latency.get_snapshot();
+	telemetry.flush_time = _flush_time.get_snapshot();
+	telemetry.batch_size = _batch_size.get_snapshot();
+	
+	std::shared_ptr<const engine_list> engines = std::atomic_load(&_engine_list);
+	
+	for(size_t i = 0; i < engines->engines.size(); i ++)
+		telemetry.engines.push_back({ engines->engines[i], engines->write_times[i]->get_snapshot() });
+	
+	return telemetry;
+}
+
+void logger::set_telemetry_interval(std::chrono::milliseconds interval)
+{
+	_telemetry_interval.store(std::max<int64_t>(interval.count(), 0), std::memory_order_relaxed);
+}
+
+void logger::set_latency_tracing(bool enabled, std::chrono::microseconds outlier_threshold)
+{
+	_outlier_threshold.store(std::chrono::duration_cast<std::chrono::nanoseconds>(outlier_threshold).count(), std::memory_order_relaxed);
+	_tracing.store(enabled, std::memory_order_relaxed);
+}
+
+latency_report logger::get_latency_report() const
+{
+	latency_report report;
+	
+	{
+		std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+		
+		report = _retired_latency;
+		
+		for(auto& producer : _producers)
+		{
+			producer_trace *trace = producer->trace.load(std::memory_order_acquire);
+			if(!trace)
+				continue;
+			
+			histogram calls = trace->calls.get_snapshot();
+			
+			report.calls.merge(calls);
+			report.threads.push_back(std::move(calls));
+			
+			std::lock_guard<spinlock> trace_lock(trace->lock);
+			
+			for(auto& site : trace->sites)
+				merge_site(report.sites, site);
+		}
+	}
+	
+	for(auto& site : report.sites)
+		site.site = descriptor::get_descriptor(site.descriptor_id);
+	
+	std::sort(report.sites.begin(), report.sites.end(), [](const call_site_latency& first, const call_site_latency& second) {
+		return (first.total > second.total);
+	});
+	
+	return report;
+}
+
+void logger::report_telemetry()
+{
+	int64_t interval = _telemetry_interval.load(std::memory_order_relaxed);
+	
+	if(interval == 0 || _teardown_flag.load() || !is_enabled(log_level::info))
+		return;
+	
+	auto now = std::chrono::steady_clock::now();
+	
+	if(now - _last_telemetry < std::chrono::milliseconds(interval))
+		return;
+	
+	_last_telemetry = now;
+	
+	// Ends up in the next flush, like any other message
+	logger_telemetry telemetry = get_telemetry();
+	
+	record record;
+	record.text().append("logger telemetry", 16);
+	
+	record.add_field("messages", telemetry.messages);
+	record.add_field("dropped", telemetry.dropped);
+	record.add_field("overflowed", telemetry.overflowed);
+	record.add_field("queued", static_cast<uint64_t>(telemetry.queued));
+	record.add_field("overflow_depth", static_cast<uint64_t>(telemetry.overflow_depth));
+	record.add_field("max_overflow_depth", static_cast<uint64_t>(telemetry.max_overflow_depth));
+	record.add_field("lock_wait_us", telemetry.lock_wait / 1000);
+	record.add_field("timed_flushes", telemetry.timed_flushes);
+	record.add_field("requested_flushes", telemetry.requested_flushes);
+	record.add_field("latency_p50_us", telemetry.latency.get_percentile(50.0) / 1000);
+	record.add_field("latency_p99_us", telemetry.latency.get_percentile(99.0) / 1000);
+	record.add_field("latency_max_us", telemetry.latency.get_max() / 1000);
+	record.add_field("flush_p99_us", telemetry.flush_time.get_percentile(99.0) / 1000);
+	record.add_field("batch_p50", telemetry.batch_size.get_percentile(50.0));
+	record.add_field("batch_max", telemetry.batch_size.get_max());
+	
+	log(message(log_level::info, std::move(record), message::deferred_time()));
 }
 
 
@@ -170,74 +1103,455 @@ void logger::flush(bool wait)
 		return;
 	}
 	
+	_requested_flushes.fetch_add(1, std::memory_order_relaxed);
 	force_flush();
 }
 
+size_t logger::emergency_flush(int fd)
+{
+	char output[emergency_output_length];
+	size_t size = 0;
+	size_t written = 0;
+	
+	// Whoever holds the locks might never release them, after a short while the producers are read regardless.
+	// The overflow buffers are changed in place under _lock, without it they are skipped
+	bool buffer_locked = try_lock_briefly(_lock);
+	bool producers_locked = try_lock_briefly(_producer_lock);
+	
+	// Same merge as drain_producers(), just without allocating. Queues are merged in groups of up to
+	// 64 producers, the messages held back by the flush thread and the overflow buffer join the first group
+	const size_t group_size = 64;
+	size_t positions[group_size];
+	size_t heads[group_size];
+	
+	size_t overflow_index = buffer_locked ? _overflow_drained : 0;
+	size_t overflow_end = buffer_locked ? _overflow.size() : 0;
+	size_t buffer_index = 0;
+	size_t buffer_end = buffer_locked ? _buffer.size() : 0;
+	
+	for(size_t first = 0; first == 0 || first < _producers.size(); first += group_size)
+	{
+		size_t count = (first < _producers.size()) ? std::min(group_size, _producers.size() - first) : 0;
+		
+		for(size_t i = 0; i < count; i ++)
+		{
+			positions[i] = _producers[first + i]->queue.get_tail();
+			heads[i] = _producers[first + i]->queue.get_head();
+		}
+		
+		while(1)
+		{
+			const message *next = nullptr;
+			size_t source = 0;
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				if(positions[i] == heads[i])
+					continue;
+				
+				const message *candidate = _producers[first + i]->queue.peek(positions[i]);
+				
+				if(!next || candidate->_sequence < next->_sequence)
+				{
+					next = candidate;
+					source = i;
+				}
+			}
+			
+			if(first == 0)
+			{
+				if(overflow_index < overflow_end && (!next || _overflow[overflow_index]._sequence < next->_sequence))
+				{
+					next = &_overflow[overflow_index];
+					source = group_size;
+				}
+				
+				if(buffer_index < buffer_end && (!next || _buffer[buffer_index]._sequence < next->_sequence))
+				{
+					next = &_buffer[buffer_index];
+					source = group_size + 1;
+				}
+			}
+			
+			if(!next)
+				break;
+			
+			if(source == group_size)
+				overflow_index ++;
+			else if(source == group_size + 1)
+				buffer_index ++;
+			else
+				positions[source] ++;
+			
+			append_emergency_line(fd, output, size, *next);
+			written ++;
+		}
+	}
+	
+	write_all(fd, output, size);
+	
+	if(producers_locked)
+		_producer_lock.unlock();
+	if(buffer_locked)
+		_lock.unlock();
+	
+	return written;
+}
+
 void logger::flush_run_loop()
 {
 	while(!_teardown_flag.load())
 	{
 		std::unique_lock<decltype(_signal_lock)> lock(_signal_lock);
-		_signal.wait_for(lock, std::chrono::milliseconds(_flush_delay));
+		
+		if(_signal.wait_for(lock, get_flush_interval()) == std::cv_status::timeout)
+			_timed_flushes.fetch_add(1, std::memory_order_relaxed);
+		else
+			_requested_flushes.fetch_add(1, std::memory_order_relaxed);
 		
 		force_flush();
 	}
 }
 
+void logger::drain_producers(std::vector<message>& buffer)
+{
+	{
+		std::lock_guard<decltype(_lock)> lock(_lock);
+		
+		// Messages held back by the last flush are older than anything that got added since
+		if(_overflow.empty())
+		{
+			std::swap(_buffer, _overflow);
+		}
+		else
+		{
+			std::move(_buffer.begin(), _buffer.end(), std::back_inserter(_overflow));
+			_buffer.clear();
+		}
+		
+		_dropped_sequences.insert(_dropped_sequences.end(), _dropped_buffer.begin(), _dropped_buffer.end());
+		_dropped_buffer.clear();
+	}
+	
+	_space_signal.notify_all();
+	
+	{
+		std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+		_drain_list = _producers;
+	}
+	
+	// Every queue, as well as the overflow buffer, is already ordered by sequence, so a k-way
+	// merge of their heads puts the batch into submission order. Queues are only drained up to
+	// their current size, otherwise a busy thread could keep the flush going forever
+	const size_t overflow_run = _drain_list.size();
+	bool orphans = false;
+	
+	_merge_heap.clear();
+	
+	for(size_t i = 0; i < _drain_list.size(); i ++)
+	{
+		auto& producer = _drain_list[i];
+		
+		size_t size = producer->queue.size();
+		if(size > 0)
+			_merge_heap.push_back({ producer->queue.front()->get_sequence(), i, size });
+		
+		orphans = (orphans || producer->orphaned.load(std::memory_order_acquire));
+	}
+	
+	_active_producers = std::max<size_t>(_merge_heap.size(), 1);
+	
+	if(!_overflow.empty())
+		_merge_heap.push_back({ _overflow.front().get_sequence(), overflow_run, _overflow.size() });
+	
+	std::make_heap(_merge_heap.begin(), _merge_heap.end());
+	
+	size_t overflow_index = 0;
+	
+	while(!_merge_heap.empty())
+	{
+		merge_cursor cursor = _merge_heap.front();
+		
+		if(cursor.sequence > _next_sequence && hold_back(cursor.sequence))
+			break;
+		
+		std::pop_heap(_merge_heap.begin(), _merge_heap.end());
+		_merge_heap.pop_back();
+		
+		_next_sequence = std::max(_next_sequence, cursor.sequence + 1);
+		
+		if(cursor.run == overflow_run)
+		{
+			// emergency_flush() reads the overflow buffer while holding _lock, so it mustn't see a moved out entry
+			std::lock_guard<decltype(_lock)> lock(_lock);
+			
+			buffer.push_back(std::move(_overflow[overflow_index ++]));
+			_overflow_drained = overflow_index;
+			
+			if((-- cursor.remaining) > 0)
+				cursor.sequence = _overflow[overflow_index].get_sequence();
+		}
+		else
+		{
+			auto& queue = _drain_list[cursor.run]->queue;
+			
+			buffer.push_back(std::move(*queue.front()));
+			queue.pop();
+			
+			if((-- cursor.remaining) > 0)
+				cursor.sequence = queue.front()->get_sequence();
+		}
+		
+		if(cursor.remaining > 0)
+		{
+			_merge_heap.push_back(cursor);
+			std::push_heap(_merge_heap.begin(), _merge_heap.end());
+		}
+	}
+	
+	if(overflow_index > 0)
+	{
+		std::lock_guard<decltype(_lock)> lock(_lock);
+		
+		_overflow.erase(_overflow.begin(), _overflow.begin() + overflow_index);
+		_overflow_drained = 0;
+	}
+	
+	// Dropped sequences below _next_sequence have been stepped over
+	_dropped_sequences.erase(_dropped_sequences.begin(), std::lower_bound(_dropped_sequences.begin(), _dropped_sequences.end(), _next_sequence));
+	_drain_list.clear();
+	
+	if(orphans)
+	{
+		// Queues of exited threads can be dropped once they are empty, nobody is going to push into them anymore
+		std::lock_guard<decltype(_producer_lock)> lock(_producer_lock);
+		_producers.erase(std::remove_if(_producers.begin(), _producers.end(), [this](const std::shared_ptr<producer>& producer) {
+			
+			if(producer->orphaned.load(std::memory_order_acquire) && producer->queue.size() == 0)
+			{
+				producer->add_counters(_retired_counters);
+				
+				if(producer_trace *trace = producer->trace.load(std::memory_order_acquire))
+				{
+					_retired_latency.calls.merge(trace->calls.get_snapshot());
+					
+					for(auto& site : trace->sites)
+						merge_site(_retired_latency.sites, site);
+				}
+				
+				return true;
+			}
+			
+			return false;
+		}), _producers.end());
+	}
+}
+
+bool logger::hold_back(uint64_t sequence)
+{
+	// A thread took _next_sequence but hasn't pushed its message yet, so everything after it has to wait
+	// for the next flush. The window is tiny, but a thread that gets stopped in it mustn't stall the logger,
+	// so a gap that stays open for too long gets skipped and the late message is written once it shows up
+	auto dropped = std::lower_bound(_dropped_sequences.begin(), _dropped_sequences.end(), _next_sequence);
+	
+	// Messages that got dropped from the overflow buffer are never going to show up
+	while(dropped != _dropped_sequences.end() && *dropped == _next_sequence)
+	{
+		_next_sequence ++;
+		dropped ++;
+	}
+	
+	if(_next_sequence == sequence)
+		return false;
+	
+	auto now = std::chrono::steady_clock::now();
+	
+	if(_gap_sequence != _next_sequence)
+	{
+		_gap_sequence = _next_sequence;
+		_gap_time = now;
+	}
+	
+	if(_teardown_flag.load() || now - _gap_time >= std::chrono::milliseconds(100))
+	{
+		_next_sequence = sequence;
+		return false;
+	}
+	
+	return true;
+}
+
+void logger::prepare_batch(flush_data& data)
+{
+	// Render deferred messages once per batch instead of once per engine, skipping the ones no engine wants.
+	// Afterwards get_text() only reads what's rendered, so asynchronous engines can share the batch
+	int threshold = _threshold.load(std::memory_order_relaxed);
+	
+	_timekeeper.calibrate();
+	
+	auto last = data.time;
+	
+	for(size_t i = 0; i < data.buffer.size(); i ++)
+	{
+		auto& message = data.buffer[i];
+		message._time = _timekeeper.convert(message._clock, message._stamp);
+		
+		if(std::chrono::duration_cast<std::chrono::seconds>(message._time - last).count() >= static_cast<long>(data.significant_time))
+			data.gaps.push_back(static_cast<uint32_t>(i));
+		
+		last = message._time;
+		
+		for(int level = 1; level <= static_cast<int>(message.get_level()); level ++)
+			data.selection[level].push_back(static_cast<uint32_t>(i));
+		
+		if(static_cast<int>(message.get_level()) >= threshold)
+			message.prepare(data.storage, _scratch);
+	}
+}
+
+std::shared_ptr<logger::flush_data> logger::acquire_batch()
+{
+	// Batches are immutable while workers hold on to them, only one that's exclusively owned by the logger can be reused
+	for(auto& batch : _batches)
+	{
+		if(batch.use_count() == 1)
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			
+			batch->buffer.clear();
+			batch->storage.reset();
+			batch->gaps.clear();
+			
+			for(auto& selection : batch->selection)
+				selection.clear();
+			
+			return batch;
+		}
+	}
+	
+	_batches.push_back(std::make_shared<flush_data>());
+	return _batches.back();
+}
+
 void logger::force_flush()
 {
-	std::lock(_lock, _flush_lock);
+	std::lock_guard<decltype(_flush_lock)> flush_lock(_flush_lock);
+	
+	struct flushing_scope
+	{
+		flushing_scope() { __flushing = true; }
+		~flushing_scope() { __flushing = false; }
+	} flushing;
+	
+	auto start = std::chrono::steady_clock::now();
 	
-	std::unique_lock<decltype(_lock)> lock(_lock, std::adopt_lock);
-	std::unique_lock<decltype(_flush_lock)> flush_lock(_flush_lock, std::adopt_lock);
+	_flushes_started.fetch_add(1);
 	
-	flush_data data(_last_message);
-	std::swap(data.buffer, _buffer);
+	std::shared_ptr<const engine_list> engines = std::atomic_load(&_engine_list);
+	std::shared_ptr<flush_data> batch = acquire_batch();
+	flush_data& data = *batch;
 	
-	lock.unlock();
+	data.time = _last_message;
+	data.significant_time = _significant_time;
+	drain_producers(data.buffer);
+	
+	uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+	if(dropped != _reported_dropped)
+	{
+		// Let the engines know that there is something missing
+		message message(log_level::warning, std::to_string(dropped - _reported_dropped) + " messages dropped");
+		message._stamp = timekeeper::stamp(message._clock);
+		
+		if(!data.buffer.empty())
+			message._sequence = data.buffer.back().get_sequence();
+		
+		data.buffer.push_back(std::move(message));
+		_reported_dropped = dropped;
+	}
 	
 	if(!data.buffer.empty())
 	{
-		std::stable_sort(data.buffer.begin(), data.buffer.end(), [](const message& a, const message& b) { return (a.get_time() < b.get_time()); });
+		prepare_batch(data);
 		
-		if(!_engines.empty())
+		if(!engines->engines.empty())
 		{
-			for(auto engine : _engines)
+			// Hand the batch to the workers first, so they write it while the synchronous engines are busy
+			size_t max_backlog = _max_backlog.load(std::memory_order_relaxed);
+			
+			for(auto& worker : engines->workers)
+			{
+				if(worker)
+					worker->push(batch, max_backlog);
+			}
+			
+			for(size_t i = 0; i < engines->engines.size(); i ++)
 			{
-				flush_engine(engine, data);
+				if(!engines->workers[i])
+					flush_engine(engines->engines[i], data, engines->write_times[i].get());
 			}
 		}
 		else
 		{
-			flush_engine(&__fallback_engine, data);
+			flush_engine(_fallback_engine.get(), data, nullptr);
 		}
 		
 		auto& message = data.buffer.back();
 		_last_message = message.get_time();
+		
+		auto now = std::chrono::system_clock::now();
+		
+		for(auto& entry : data.buffer)
+			_latency.record(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.get_time()).count(), 0));
+		
+		_batch_size.record(data.buffer.size());
 	}
 	
+	auto duration = std::chrono::steady_clock::now() - start;
+	_flush_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	
+	// Asynchronous engines don't hold up the flush, so the scheduler only sees the synchronous ones.
+	// Its rate and batch size cover all threads, while every thread compares the threshold against
+	// its own queue, so both are spread over the queues that are in use
+	_scheduler.update(data.buffer.size(), duration, _producer_capacity.load(std::memory_order_relaxed) * _active_producers);
+	
+	if(!_fixed_threshold.load(std::memory_order_relaxed))
+		_flush_buffer_threshold.store(std::max<size_t>(_scheduler.get_batch_size() / _active_producers, 1), std::memory_order_relaxed);
+	
+	// Engines removed during the flush can be finalized now
+	engines.reset();
+	
+	_flushes_finished.fetch_add(1);
+	_retire_signal.notify_all();
+	
+	report_telemetry();
+	
 	_flush_flag.clear();
 }
 
-void logger::flush_engine(logging_engine *engine, const flush_data& data)
+void logger::flush_engine(logging_engine *engine, const flush_data& data, histogram_recorder *write_time)
 {
 	if(!engine->is_good())
 		return;
 	
-	auto last  = data.time;
-	auto level = engine->get_log_level();
+	auto start = std::chrono::steady_clock::now();
 	
-	for(auto& message : data.buffer)
-	{
-		long offset = std::chrono::duration_cast<std::chrono::seconds>(message.get_time() - last).count();
-		last = message.get_time();
-		
-		if(offset >= _significant_time)
-			engine->significant_time_passed();
-		
-		if(message.get_level() >= level)
-			engine->write(message);
-	}
+	message_batch batch = data.select(engine->get_log_level());
+	
+	if(!batch.empty() || batch.get_gap_count() > 0)
+		engine->write_batch(batch);
 	
 	engine->flush();
+	
+	if(write_time)
+		write_time->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+message_batch logger::flush_data::select(log_level level) const
+{
+	const std::vector<uint32_t>& selection = this->selection[static_cast<size_t>(level)];
+	
+	if(level == log_level::debug || selection.size() == buffer.size())
+		return message_batch(buffer.data(), nullptr, buffer.size(), gaps.data(), gaps.size());
+	
+	return message_batch(buffer.data(), selection.data(), selection.size(), gaps.data(), gaps.size());
 }
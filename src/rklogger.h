@@ -24,9 +24,27 @@
 #include <atomic>
 #include <thread>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
 
 #include "rksingleton.h"
 #include "rkspinlock.h"
+#include "rkrecord.h"
+#include "rkdescriptor.h"
+#include "rkarena.h"
+#include "rkclock.h"
+#include "rkscheduler.h"
+#include "rktelemetry.h"
+
+// Log statements below this level are removed at compile time by the logging macros and loggable,
+// 0 = debug, 1 = info, 2 = warning, 3 = error, 4 = critical
+#ifndef RATATOSKR_MIN_LOG_LEVEL
+#define RATATOSKR_MIN_LOG_LEVEL 0
+#endif
 
 namespace ratatoskr
 {
@@ -39,25 +57,159 @@ namespace ratatoskr
 		critical
 	};
 	
+	enum class dispatch_mode
+	{
+		synchronous, // The engine is written to by the flush thread
+		asynchronous // The engine gets a worker thread of its own, which consumes the same batches
+	};
+	
+	enum class overflow_policy
+	{
+		block, // The producer waits for the flush thread to make room
+		drop_newest, // New messages are discarded
+		drop_oldest, // The oldest queued message makes room for the new one
+		drop_below_level // New messages below the drop level are discarded, the others are still queued
+	};
+	
+	struct engine_backlog
+	{
+		size_t batches; // Batches waiting for the engine, including the one being written
+		size_t messages; // Messages in those batches
+		uint64_t dropped; // Messages the engine missed because its backlog was full
+	};
+	
+	class logging_engine;
+	
 	class message
 	{
 	public:
 		message(log_level level, const std::string& message);
 		message(log_level level, std::string&& message);
+		message(log_level level, record&& record);
 		
 		log_level get_level() const { return _level; }
-		std::chrono::system_clock::time_point get_time() const { return _time; }
+		std::chrono::system_clock::time_point get_time() const { return _time; } // Creation time, replaced with the submission time by the logger
+		uint64_t get_sequence() const { return _sequence; }
 		
+		// Renders the text into a string on the first call, which allocates. Safe to call from several threads
 		const std::string& get_message() const;
+		const record& get_record() const { return _record; }
+		
+		// The message text, unlike get_message() this doesn't allocate for messages that went through the logger.
+		// Only valid as long as the message is
+		const char *get_text() const;
+		size_t get_length() const;
+		
+		// Length of the message text without the fields of the record, which get_text() has appended
+		size_t get_message_length() const;
+		
+		void render(buffer& output) const { output.append(get_text(), get_length()); }
 		
 	private:
+		friend class logger;
+		friend class loggable;
+		
+		// Messages created by the logger are stamped when they are queued, so they skip reading the clock on creation
+		struct deferred_time {};
+		message(log_level level, record&& record, deferred_time);
+		
+		// Text rendered by the logger into the arena of the flush batch. Copies of the
+		// message don't inherit it, since they might outlive the batch
+		struct rendered_text
+		{
+			rendered_text() :
+				data(nullptr),
+				length(0),
+				message_length(0)
+			{}
+			
+			rendered_text(const rendered_text&) :
+				rendered_text()
+			{}
+			
+			rendered_text& operator= (const rendered_text&)
+			{
+				data = nullptr;
+				length = 0;
+				message_length = 0;
+				
+				return *this;
+			}
+			
+			const char *data;
+			uint32_t length;
+			uint32_t message_length; // Without the fields
+		};
+		
+		void prepare(arena& arena, buffer& scratch);
+		
 		log_level _level;
-		std::string _message;
-		mutable std::string _formatted_time;
+		clock_source _clock;
+		uint64_t _sequence;
+		uint64_t _stamp; // Raw time stamp taken on submission, converted into _time by the flush thread
 		std::chrono::system_clock::time_point _time;
+		mutable std::shared_ptr<const std::string> _message; // Rendered on the first call to get_message()
+		record _record; // Strings are stored as text records
+		rendered_text _rendered;
+	};
+	
+	// The messages of a flush that pass an engines log level, in sequence order. Only valid during the call it's passed to
+	class message_batch
+	{
+	public:
+		class iterator
+		{
+		public:
+			iterator(const message_batch *batch, size_t index) :
+				_batch(batch),
+				_index(index)
+			{}
+			
+			const message& operator* () const { return (*_batch)[_index]; }
+			const message *operator-> () const { return &(*_batch)[_index]; }
+			
+			iterator& operator++ () { _index ++; return *this; }
+			
+			bool operator== (const iterator& other) const { return (_index == other._index); }
+			bool operator!= (const iterator& other) const { return (_index != other._index); }
+			
+		private:
+			const message_batch *_batch;
+			size_t _index;
+		};
+		
+		// A null indices pointer selects all messages
+		message_batch(const message *messages, const uint32_t *indices, size_t size, const uint32_t *gaps, size_t gap_count) :
+			_messages(messages),
+			_indices(indices),
+			_size(size),
+			_gaps(gaps),
+			_gap_count(gap_count)
+		{}
+		
+		size_t size() const { return _size; }
+		bool empty() const { return (_size == 0); }
+		
+		const message& operator[] (size_t index) const { return _messages[get_position(index)]; }
+		
+		iterator begin() const { return iterator(this, 0); }
+		iterator end() const { return iterator(this, _size); }
+		
+		// Position of the message within the whole flush, including the messages that didn't pass the level
+		size_t get_position(size_t index) const { return _indices ? _indices[index] : index; }
+		
+		// Positions of the messages that were submitted a significant amount of time after their predecessor
+		size_t get_gap_count() const { return _gap_count; }
+		size_t get_gap(size_t index) const { return _gaps[index]; }
+		
+	private:
+		const message *_messages;
+		const uint32_t *_indices;
+		size_t _size;
+		const uint32_t *_gaps;
+		size_t _gap_count;
 	};
 	
-	class logging_engine;
 	class logger : public singleton<logger>
 	{
 	public:
@@ -69,52 +221,238 @@ namespace ratatoskr
 		void log(log_level level, const std::string& message);
 		void log(log_level level, std::string&& message);
 		
-		void set_flush_delay(size_t delay); // Defaults to 250ms
-		void set_flush_buffer_threshold(size_t threshold); // Defaults to 1024 messages
+		// True if at least one engine accepts messages of the given level. Only a relaxed load, so it's cheap
+		// enough to be checked before doing any work to create a message
+		bool is_enabled(log_level level) const { return (static_cast<int>(level) >= _threshold.load(std::memory_order_relaxed)); }
+		
+		template<class ... Args>
+		void log(const descriptor& descriptor, const Args& ... args)
+		{
+			record record(descriptor.get_id());
+			append_arguments(record, args...);
+			
+			log(message(descriptor.get_level(), std::move(record), message::deferred_time()));
+		}
+		
+		// The flush interval and the number of queued messages that trigger an early flush adapt to the message rate
+		// and the time the engines take to write, so messages are delivered within the latency target at the 99th
+		// percentile and flushes are large enough for the throughput target. Defaults to 100ms and no throughput target
+		void set_flush_targets(std::chrono::milliseconds latency, size_t throughput = 0);
+		
+		// Fixed values instead of the adaptive ones, until set_flush_targets() gets called again
+		void set_flush_delay(size_t delay);
+		void set_flush_buffer_threshold(size_t threshold);
+		
+		std::chrono::microseconds get_flush_interval() const;
+		size_t get_flush_buffer_threshold() const { return _flush_buffer_threshold.load(std::memory_order_relaxed); }
 		void set_significant_time(size_t time); // Defaults to 10s
+		void set_producer_capacity(size_t capacity); // Defaults to 1024 messages per thread, affects only new threads
+		void set_clock_source(clock_source source); // Defaults to clock_source::system
+		void set_max_backlog(size_t messages); // Defaults to 65536 messages per asynchronous engine
+		
+		// Applies once all of a threads queue and the shared overflow buffer are full
+		void set_overflow_policy(overflow_policy policy, log_level level = log_level::warning); // Defaults to overflow_policy::block
+		void set_max_overflow(size_t messages); // Defaults to 1048576 messages
 		
-		void add_logging_engine(logging_engine *engine);
+		uint64_t get_dropped_messages() const { return _dropped.load(std::memory_order_relaxed); }
+		
+		// Neither waits for a flush in progress, except for removing an engine, which returns once the last flush
+		// that uses the engine is done and the engine got finalized. An engine can only be added to one logger
+		// at a time, since engines aren't synchronized against the flush threads of other loggers. Adding an engine
+		// that already belongs to a logger, including this one, fails and returns false
+		bool add_logging_engine(logging_engine *engine, dispatch_mode mode = dispatch_mode::synchronous);
 		void remove_logging_engine(logging_engine *engine);
-		std::vector<logging_engine *> get_logging_engines();
+		std::vector<logging_engine *> get_logging_engines() const;
+		
+		// Always empty for synchronous engines
+		engine_backlog get_backlog(logging_engine *engine) const;
 		
+		// Waiting only guarantees that synchronous engines have written all messages,
+		// asynchronous engines have them queued up at that point
 		void flush(bool wait = false);
 		
+		// Writes the messages that haven't been flushed yet straight to the file descriptor and returns their number. Only
+		// uses async-signal-safe operations and never waits for a lock, so it works from a signal handler even if the
+		// crashed thread held one, at the price of maybe missing or repeating a message the flush thread is working on.
+		// Messages stay queued, this is meant for crash_handler and custom handlers of fatal signals
+		size_t emergency_flush(int fd);
+		
+		logger_telemetry get_telemetry() const;
+		
+		// Logs the most important numbers of get_telemetry() as fields of an info message at the given
+		// interval, counting from the previous report. A zero interval turns it off, which is the default
+		void set_telemetry_interval(std::chrono::milliseconds interval);
+		
+		// Times every log() call into a histogram of the calling thread. Calls that take longer than the outlier threshold
+		// are attributed to their call site and to the step that stalled them. Costs a couple of clock reads per call while
+		// it's on, and a relaxed load while it's off, which is the default
+		void set_latency_tracing(bool enabled, std::chrono::microseconds outlier_threshold = std::chrono::microseconds(50));
+		latency_report get_latency_report() const;
+		
+		class producer;
+		
+	protected:
+		friend class logging_engine;
+		void update_threshold();
+		
 	private:
+		class engine_worker;
+		
+		// Published as a whole and never modified afterwards, so a flush can keep using the list it
+		// started with while engines get added or removed
+		struct engine_list
+		{
+			std::vector<logging_engine *> engines;
+			std::vector<std::shared_ptr<engine_worker>> workers; // Parallel to engines, nullptr for synchronous engines
+			std::vector<std::shared_ptr<histogram_recorder>> write_times; // Parallel to engines, recorded by whoever writes to the engine
+		};
+		
+		// Batches are reused once no worker holds on to them anymore, so the buffer keeps
+		// its capacity and the arena its chunks once the logger has warmed up
 		struct flush_data
 		{
-			flush_data(std::chrono::system_clock::time_point t) :
-				time(t)
-			{}
-			
 			std::chrono::system_clock::time_point time;
+			size_t significant_time;
 			std::vector<message> buffer;
+			arena storage; // Holds the text of messages that needed rendering
+			
+			// Indices of the messages at or above each level, computed once per batch so engines don't filter on their own.
+			// Debug passes everything and has no list
+			std::vector<uint32_t> selection[static_cast<size_t>(log_level::critical) + 1];
+			std::vector<uint32_t> gaps; // Messages that came significant_time or more after the previous one
+			
+			message_batch select(log_level level) const;
+		};
+		
+		// Head of one of the sequence ordered runs that get merged into a batch
+		struct merge_cursor
+		{
+			uint64_t sequence;
+			size_t run; // Index into _drain_list, or _drain_list.size() for the overflow buffer
+			size_t remaining;
+			
+			bool operator< (const merge_cursor& other) const { return (sequence > other.sequence); } // Min heap
 		};
 		
 		void force_flush();
 		void flush_run_loop();
-		void flush_engine(logging_engine *engine, const flush_data& data);
+		static void flush_engine(logging_engine *engine, const flush_data& data, histogram_recorder *write_time);
+		void report_telemetry();
+		
+		std::shared_ptr<flush_data> acquire_batch();
+		
+		static void append_arguments(record&) {}
+		
+		template<class T, class ... Args>
+		static void append_arguments(record& record, const T& value, const Args& ... args)
+		{
+			record.append(value);
+			append_arguments(record, args...);
+		}
+		
+		producer *get_producer();
+		void drain_producers(std::vector<message>& buffer);
+		bool hold_back(uint64_t sequence);
+		void prepare_batch(flush_data& data);
+		
+		uint64_t _id;
+		std::atomic<uint64_t> _sequence;
 		
 		std::atomic<bool> _teardown_flag;
-		std::vector<message> _buffer;
+		std::deque<message> _buffer; // Overflow for full producer queues, guarded by _lock
+		std::deque<message> _overflow; // Swapped with _buffer when draining, keeps held back messages between flushes. Changed under _lock
+		size_t _overflow_drained; // Leading entries of _overflow that were moved into the current batch, guarded by _lock
+		std::vector<uint64_t> _dropped_buffer; // Sequences of messages dropped out of _buffer, guarded by _lock
+		std::vector<uint64_t> _dropped_sequences; // Moved over from _dropped_buffer when draining
+		
+		size_t _max_overflow;
+		overflow_policy _overflow_policy;
+		log_level _drop_level;
+		std::atomic<uint64_t> _dropped;
+		uint64_t _reported_dropped;
+		size_t _max_overflow_depth; // Guarded by _lock
+		std::mutex _space_lock;
+		std::condition_variable _space_signal; // Signalled when the overflow buffer got drained
 		std::chrono::system_clock::time_point _last_message;
 		
-		std::vector<logging_engine *> _engines;
+		std::shared_ptr<const engine_list> _engine_list; // Only accessed through std::atomic_load() and std::atomic_store()
+		std::unique_ptr<logging_engine> _fallback_engine; // Writes to std::cout while there are no engines
+		std::mutex _engine_lock; // Serializes changes to the engine list
+		std::atomic<uint64_t> _flushes_started;
+		std::atomic<uint64_t> _flushes_finished;
+		std::mutex _retire_lock;
+		std::condition_variable _retire_signal; // Signalled when a flush lets go of its engine list
+		std::atomic<size_t> _max_backlog;
+		std::atomic<int> _threshold; // Lowest log level accepted by any engine
 		
-		spinlock _lock;
+		mutable adaptive_lock _lock;
 		size_t _significant_time;
 		
+		mutable adaptive_lock _producer_lock;
+		std::vector<std::shared_ptr<producer>> _producers;
+		
+		// Counters of the producers that got dropped, guarded by _producer_lock
+		struct producer_counters
+		{
+			uint64_t overflowed;
+			uint64_t blocked;
+			uint64_t lock_contentions;
+			uint64_t lock_wait;
+			uint64_t threshold_triggers;
+		};
+		
+		producer_counters _retired_counters;
+		latency_report _retired_latency; // Traces of the producers that got dropped, guarded by _producer_lock
+		std::atomic<bool> _tracing;
+		std::atomic<uint64_t> _outlier_threshold; // Nanoseconds
+		std::vector<std::shared_ptr<producer>> _drain_list;
+		std::vector<merge_cursor> _merge_heap;
+		size_t _active_producers; // Queues that had messages at the last drain, the scheduler splits the batch size between them
+		std::atomic<size_t> _producer_capacity;
+		std::atomic<clock_source> _clock_source;
+		
 		std::mutex _signal_lock;
 		std::condition_variable _signal;
 		
-		size_t _flush_delay;
-		size_t _flush_buffer_threshold;
+		std::atomic<size_t> _flush_delay;
+		std::atomic<bool> _fixed_delay;
+		std::atomic<size_t> _flush_buffer_threshold;
+		std::atomic<bool> _fixed_threshold;
+		flush_scheduler _scheduler;
+		
+		// Recorded by the thread holding _flush_lock
+		histogram_recorder _latency;
+		histogram_recorder _flush_time;
+		histogram_recorder _batch_size;
+		std::atomic<uint64_t> _timed_flushes;
+		std::atomic<uint64_t> _requested_flushes;
+		std::atomic<int64_t> _telemetry_interval; // Milliseconds
+		std::chrono::steady_clock::time_point _last_telemetry;
+		
+		std::vector<std::shared_ptr<flush_data>> _batches;
+		small_buffer<512> _scratch;
+		timekeeper _timekeeper;
+		
+		uint64_t _next_sequence; // Sequence of the next message to be flushed
+		uint64_t _gap_sequence;
+		std::chrono::steady_clock::time_point _gap_time; // When the flush thread first waited on _gap_sequence
+		
 		std::thread _flush_thread;
 		std::mutex _flush_lock;
 		std::atomic_flag _flush_flag;
 	};
 }
 
-#define __rklog(level, str) ratatoskr::logger::get_shared_instance()->log(ratatoskr::log_level::level, str)
+#define __rkenabled_to(target, level) \
+	(static_cast<int>(ratatoskr::log_level::level) >= RATATOSKR_MIN_LOG_LEVEL && (target).is_enabled(ratatoskr::log_level::level))
+#define __rkenabled(level) \
+	__rkenabled_to(*ratatoskr::logger::get_shared_instance(), level)
+
+#define __rklog(level, str) \
+	do { \
+		if(__rkenabled(level)) \
+			ratatoskr::logger::get_shared_instance()->log(ratatoskr::log_level::level, str); \
+	} while(0)
 
 #define rkdebug(str)    __rklog(debug, str)
 #define rkinfo(str)     __rklog(info, str)
@@ -122,4 +460,27 @@ namespace ratatoskr
 #define rkerror(str)    __rklog(error, str)
 #define rkcritical(str) __rklog(critical, str)
 
+// Format string logging, ie. rklog(info, "{} took {}ms", name, time). The static parts of the message are stored
+// once per call site and the format string is checked against the number of arguments at compile time.
+// rklog_to() does the same for any logger like object, ie. a logger instance or a sharded_logger
+#define rklog_to(target, level, format, ...) \
+	do { \
+		static_assert(ratatoskr::detail::count_placeholders(format) >= 0, "Unbalanced braces in log format string"); \
+		static_assert(ratatoskr::detail::count_placeholders(format) == decltype(ratatoskr::detail::count_arguments(__VA_ARGS__))::value, "Log format string doesn't match the number of arguments"); \
+		if(__rkenabled_to(target, level)) \
+		{ \
+			static const ratatoskr::descriptor __rkdescriptor(ratatoskr::log_level::level, format, __FILE__, __LINE__); \
+			(target).log(__rkdescriptor, ##__VA_ARGS__); \
+		} \
+	} while(0)
+
+#define rklog(level, format, ...) \
+	rklog_to(*ratatoskr::logger::get_shared_instance(), level, format, ##__VA_ARGS__)
+
+#define rkdebugf(...)    rklog(debug, __VA_ARGS__)
+#define rkinfof(...)     rklog(info, __VA_ARGS__)
+#define rkwarningf(...)  rklog(warning, __VA_ARGS__)
+#define rkerrorf(...)    rklog(error, __VA_ARGS__)
+#define rkcriticalf(...) rklog(critical, __VA_ARGS__)
+
 #endif /* _RATATOSKR_LOGGER_H_ */
@@ -20,6 +20,23 @@
 
 using namespace ratatoskr;
 
+namespace
+{
+	struct level_text
+	{
+		const char *text;
+		size_t length;
+	};
+	
+	const level_text __log_levels[] = {
+		{ "(dbg)", 5 },
+		{ "(info)", 6 },
+		{ "(warn)", 6 },
+		{ "(err)", 5 },
+		{ "(crit)", 6 }
+	};
+}
+
 // ---------------------
 // MARK: -
 // MARK: logging_engine
@@ -28,23 +45,61 @@ using namespace ratatoskr;
 void logging_engine::set_log_level(log_level level)
 {
 	_level.store(level);
+	
+	std::lock_guard<decltype(_logger_lock)> lock(_logger_lock);
+	
+	if(_logger)
+		_logger->update_threshold();
 }
 
-const char *logging_engine::translate_log_level(log_level level)
+bool logging_engine::attach(logger *logger)
+{
+	std::lock_guard<decltype(_logger_lock)> lock(_logger_lock);
+	
+	if(_logger)
+		return false;
+	
+	_logger = logger;
+	return true;
+}
+
+void logging_engine::detach(logger *logger)
+{
+	std::lock_guard<decltype(_logger_lock)> lock(_logger_lock);
+	
+	if(_logger == logger)
+		_logger = nullptr;
+}
+
+void logging_engine::write_batch(const message_batch& batch)
 {
-	switch(level)
+	size_t gap = 0;
+	
+	for(size_t i = 0; i < batch.size(); i ++)
 	{
-		case log_level::debug:
-			return "(dbg)";
-		case log_level::info:
-			return "(info)";
-		case log_level::warning:
-			return "(warn)";
-		case log_level::error:
-			return "(err)";
-		case log_level::critical:
-			return "(crit)";
+		size_t position = batch.get_position(i);
+		
+		for(; gap < batch.get_gap_count() && batch.get_gap(gap) <= position; gap ++)
+			significant_time_passed();
+		
+		write(batch[i]);
 	}
+	
+	for(; gap < batch.get_gap_count(); gap ++)
+		significant_time_passed();
+}
+
+const char *logging_engine::translate_log_level(log_level level)
+{
+	return __log_levels[static_cast<size_t>(level)].text;
+}
+
+const char *logging_engine::translate_log_level(log_level level, size_t& length)
+{
+	const level_text& text = __log_levels[static_cast<size_t>(level)];
+	
+	length = text.length;
+	return text.text;
 }
 
 // ---------------------
@@ -69,7 +124,20 @@ void stream_logging_engine::flush()
 
 void stream_logging_engine::write(const message& message)
 {
-	_stream << translate_log_level(message.get_level()) << " " << message.get_message() << "\n";
+	_formatter.format(_buffer, message);
+	
+	_stream.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+	_buffer.clear();
+}
+
+void stream_logging_engine::write_batch(const message_batch& batch)
+{
+	// One write for the whole batch instead of three stream operations per message
+	for(auto& message : batch)
+		_formatter.format(_buffer, message);
+	
+	_stream.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+	_buffer.clear();
 }
 
 void stream_logging_engine::finalize()
@@ -22,6 +22,9 @@
 #include <iostream>
 #include <atomic>
 #include "rklogger.h"
+#include "rkspinlock.h"
+#include "rkbuffer.h"
+#include "rktextformatter.h"
 
 namespace ratatoskr
 {
@@ -37,17 +40,34 @@ namespace ratatoskr
 		virtual void write(const message& message) = 0;
 		virtual void significant_time_passed() {}
 		
+		// Called once per flush with the messages that pass the engines log level. The default calls write() and
+		// significant_time_passed() for each message, engines can override it to format the whole batch at once
+		virtual void write_batch(const message_batch& batch);
+		
 		void set_log_level(log_level level);
 		log_level get_log_level() const { return _level.load(); }
 		
 		static const char *translate_log_level(log_level level);
+		static const char *translate_log_level(log_level level, size_t& length);
 		
 	protected:
+		friend class logger;
+		
+		// The logger the engine is registered with, it gets notified when the log level changes. An engine
+		// belongs to one logger at a time, attach() fails if it already has one
+		bool attach(logger *logger);
+		void detach(logger *logger);
+		
 		logging_engine() :
-			_level(log_level::info)
+			_level(log_level::info),
+			_logger(nullptr)
 		{}
 		
 		std::atomic<log_level> _level;
+		
+	private:
+		adaptive_lock _logger_lock;
+		logger *_logger;
 	};
 	
 	class stream_logging_engine : public logging_engine
@@ -60,9 +80,14 @@ namespace ratatoskr
 		void finalize() final;
 		
 		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+		line_formatter& get_formatter() { return _formatter; }
 		
 	private:
 		std::ostream& _stream;
+		line_formatter _formatter;
+		small_buffer<4096> _buffer;
 	};
 }
 
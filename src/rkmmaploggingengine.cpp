@@ -0,0 +1,363 @@
+//
+//  rkmmaploggingengine.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rkmmaploggingengine.h"
+
+using namespace ratatoskr;
+
+static const char __ring_magic[8] = { 'R', 'K', 'R', 'I', 'N', 'G', '\0', '\0' };
+static const uint32_t __ring_version = 1;
+static const uint32_t __padding_flag = 1;
+
+static uint64_t align_record(uint64_t size)
+{
+	return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+// Position of the record following the one at position, works for padding and skipped space as well
+static uint64_t next_record(const char *ring, uint64_t capacity, uint64_t position)
+{
+	uint64_t offset = position % capacity;
+	uint64_t space  = capacity - offset;
+	
+	if(space < sizeof(mmap_logging_engine::record_header))
+		return position + space;
+	
+	const mmap_logging_engine::record_header *header = reinterpret_cast<const mmap_logging_engine::record_header *>(ring + offset);
+	return position + header->size;
+}
+
+// Reserves the blocks of the file up front, writing to a hole of a sparse file on a full disk raises SIGBUS
+static bool allocate_file(int fd, off_t size)
+{
+#if defined(__APPLE__)
+	// F_PREALLOCATE allocates relative to the physical end of the file, an existing ring only needs what's missing
+	struct stat info;
+	if(::fstat(fd, &info) != 0)
+		return false;
+	
+	off_t missing = size - static_cast<off_t>(info.st_blocks) * 512;
+	if(missing > 0)
+	{
+		fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, missing, 0 };
+		
+		if(::fcntl(fd, F_PREALLOCATE, &store) == -1)
+		{
+			store.fst_flags = F_ALLOCATEALL;
+			
+			if(::fcntl(fd, F_PREALLOCATE, &store) == -1)
+				return false;
+		}
+	}
+	
+	return (::ftruncate(fd, size) == 0);
+#else
+	return (::posix_fallocate(fd, 0, size) == 0);
+#endif
+}
+
+static bool is_valid_level(int32_t level)
+{
+	return (level >= static_cast<int32_t>(log_level::debug) && level <= static_cast<int32_t>(log_level::critical));
+}
+
+// Checks the record at position before anyone follows its size, skipped space at the end of the ring is fine.
+// Zeroed pages after a power loss would otherwise have a size of 0, which never moves on
+static bool is_valid_record(const char *ring, uint64_t capacity, uint64_t position)
+{
+	uint64_t offset = position % capacity;
+	
+	if(position % 8 != 0)
+		return false;
+	
+	if(capacity - offset < sizeof(mmap_logging_engine::record_header))
+		return true;
+	
+	const mmap_logging_engine::record_header *record = reinterpret_cast<const mmap_logging_engine::record_header *>(ring + offset);
+	
+	return (record->size >= sizeof(mmap_logging_engine::record_header) && record->size % 8 == 0 && record->size <= capacity - offset &&
+			sizeof(mmap_logging_engine::record_header) + record->length <= record->size && is_valid_level(record->level));
+}
+
+mmap_logging_engine::mmap_logging_engine(const std::string& path, size_t capacity) :
+	_fd(-1),
+	_mapping(nullptr),
+	_mapping_size(0),
+	_header(nullptr),
+	_ring(nullptr),
+	_capacity(0)
+{
+	size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+	
+	capacity = std::max(capacity, page_size);
+	capacity = ((capacity + page_size - 1) / page_size) * page_size;
+	
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(_fd < 0)
+		return;
+	
+	_mapping_size = page_size + capacity;
+	
+	struct stat info;
+	bool existing = (::fstat(_fd, &info) == 0 && static_cast<size_t>(info.st_size) == _mapping_size);
+	
+	if((!existing && ::ftruncate(_fd, 0) != 0) || !allocate_file(_fd, static_cast<off_t>(_mapping_size)))
+	{
+		finalize();
+		return;
+	}
+	
+	void *mapping = ::mmap(nullptr, _mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if(mapping == MAP_FAILED)
+	{
+		finalize();
+		return;
+	}
+	
+	_mapping = static_cast<char *>(mapping);
+	_header = reinterpret_cast<file_header *>(_mapping);
+	_ring = _mapping + page_size;
+	_capacity = capacity;
+	
+	// Continue the ring of an earlier run if it's compatible, otherwise start over
+	bool compatible = (existing && std::memcmp(_header->magic, __ring_magic, sizeof(__ring_magic)) == 0 && _header->version == __ring_version &&
+					   _header->header_size == page_size && _header->capacity == capacity && _header->tail.load() <= _header->head.load() &&
+					   _header->head.load() - _header->tail.load() <= capacity);
+	
+	if(!compatible)
+	{
+		std::memcpy(_header->magic, __ring_magic, sizeof(__ring_magic));
+		_header->version = __ring_version;
+		_header->header_size = static_cast<uint32_t>(page_size);
+		_header->capacity = capacity;
+		_header->head.store(0);
+		_header->tail.store(0);
+		
+		return;
+	}
+	
+	// Walk the records the way a reader does and cut the ring off at the first one that's damaged, the
+	// records up to there are kept and the next write starts over at that position
+	uint64_t head = _header->head.load();
+	uint64_t position = _header->tail.load();
+	
+	while(position < head)
+	{
+		uint64_t next = next_record(_ring, _capacity, position);
+		
+		if(!is_valid_record(_ring, _capacity, position) || next > head)
+			break;
+		
+		position = next;
+	}
+	
+	if(position != head)
+		_header->head.store(position);
+}
+
+mmap_logging_engine::~mmap_logging_engine()
+{
+	finalize();
+}
+
+
+bool mmap_logging_engine::is_good() const
+{
+	return (_mapping != nullptr);
+}
+
+void mmap_logging_engine::flush()
+{
+	// The page cache owns the data once it's written to the mapping, there is nothing to flush
+}
+
+void mmap_logging_engine::finalize()
+{
+	if(_mapping)
+	{
+		::munmap(_mapping, _mapping_size);
+		
+		_mapping = nullptr;
+		_header = nullptr;
+		_ring = nullptr;
+	}
+	
+	if(_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+void mmap_logging_engine::reserve(uint64_t end)
+{
+	// Drop the oldest records until everything up to end fits into the ring, the tail has to be
+	// published before the records are overwritten, so a reader never sees a half written record
+	uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+	
+	if(tail + _capacity >= end)
+		return;
+	
+	uint64_t head = _header->head.load(std::memory_order_relaxed);
+	
+	while(tail + _capacity < end)
+	{
+		uint64_t next = next_record(_ring, _capacity, tail);
+		
+		// Someone else wrote into the ring, give up on the records instead of following a bogus size
+		if(!is_valid_record(_ring, _capacity, tail) || next > head)
+		{
+			tail = head;
+			break;
+		}
+		
+		tail = next;
+	}
+	
+	_header->tail.store(tail, std::memory_order_release);
+}
+
+void mmap_logging_engine::write(const message& message)
+{
+	if(!_mapping)
+		return;
+	
+	// A single message may take up a quarter of the ring at most
+	size_t length = std::min(message.get_length(), static_cast<size_t>(_capacity / 4));
+	uint64_t size = align_record(sizeof(record_header) + length);
+	
+	uint64_t head = _header->head.load(std::memory_order_relaxed);
+	uint64_t space = _capacity - (head % _capacity);
+	
+	if(space < size)
+	{
+		reserve(head + space);
+		
+		if(space >= sizeof(record_header))
+		{
+			record_header *padding = reinterpret_cast<record_header *>(_ring + (head % _capacity));
+			std::memset(padding, 0, sizeof(record_header));
+			
+			padding->size = static_cast<uint32_t>(space);
+			padding->flags = __padding_flag;
+		}
+		
+		head += space;
+	}
+	
+	reserve(head + size);
+	
+	char *data = _ring + (head % _capacity);
+	record_header *header = reinterpret_cast<record_header *>(data);
+	
+	header->size = static_cast<uint32_t>(size);
+	header->length = static_cast<uint32_t>(length);
+	header->sequence = message.get_sequence();
+	header->time = std::chrono::duration_cast<std::chrono::nanoseconds>(message.get_time().time_since_epoch()).count();
+	header->level = static_cast<int32_t>(message.get_level());
+	header->flags = 0;
+	
+	std::memcpy(data + sizeof(record_header), message.get_text(), length);
+	
+	_header->head.store(head + size, std::memory_order_release);
+}
+
+void mmap_logging_engine::write_batch(const message_batch& batch)
+{
+	for(auto& message : batch)
+		write(message);
+}
+
+
+
+bool mmap_logging_engine::read(const std::string& path, const std::function<void (const entry&)>& callback)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return false;
+	
+	struct stat info;
+	if(::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(file_header))
+	{
+		::close(fd);
+		return false;
+	}
+	
+	size_t size = static_cast<size_t>(info.st_size);
+	void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	
+	::close(fd);
+	
+	if(mapping == MAP_FAILED)
+		return false;
+	
+	const char *data = static_cast<const char *>(mapping);
+	const file_header *header = reinterpret_cast<const file_header *>(data);
+	
+	bool valid = (std::memcmp(header->magic, __ring_magic, sizeof(__ring_magic)) == 0 && header->version == __ring_version &&
+				  header->header_size >= sizeof(file_header) && header->capacity > 0 && header->header_size + header->capacity == size);
+	
+	if(valid)
+	{
+		const char *ring = data + header->header_size;
+		uint64_t capacity = header->capacity;
+		
+		uint64_t head = header->head.load(std::memory_order_acquire);
+		uint64_t position = header->tail.load(std::memory_order_acquire);
+		
+		if(position > head || head - position > capacity)
+			position = head; // Corrupted header, there is no telling where the records start
+		
+		while(position < head)
+		{
+			// Stop at anything that doesn't look like a record, rather than reading garbage
+			if(!is_valid_record(ring, capacity, position))
+				break;
+			
+			uint64_t offset = position % capacity;
+			
+			if(capacity - offset >= sizeof(record_header))
+			{
+				const record_header *record = reinterpret_cast<const record_header *>(ring + offset);
+				
+				if(!(record->flags & __padding_flag))
+				{
+					entry entry;
+					entry.level = static_cast<log_level>(record->level);
+					entry.sequence = record->sequence;
+					entry.time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(record->time)));
+					entry.text = reinterpret_cast<const char *>(record + 1);
+					entry.length = record->length;
+					
+					callback(entry);
+				}
+			}
+			
+			position = next_record(ring, capacity, position);
+		}
+	}
+	
+	::munmap(mapping, size);
+	return valid;
+}
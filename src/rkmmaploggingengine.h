@@ -0,0 +1,97 @@
+//
+//  rkmmaploggingengine.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_MMAPLOGGINGENGINE_H_
+#define _RATATOSKR_MMAPLOGGINGENGINE_H_
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include "rkloggingengine.h"
+
+namespace ratatoskr
+{
+	// Writes messages into a memory mapped file that is used as a ring buffer. The page cache keeps
+	// the last messages around even if the process gets killed, and writing doesn't involve syscalls.
+	// The file can be decoded with mmap_logging_engine::read(), or the rkringdump tool.
+	class mmap_logging_engine : public logging_engine
+	{
+	public:
+		// Layout of the file, a header page followed by the ring. Positions are absolute byte offsets
+		// that only ever grow, the ring offset is position % capacity
+		struct file_header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t header_size;
+			uint64_t capacity;
+			std::atomic<uint64_t> head; // Published after a record was written completely
+			std::atomic<uint64_t> tail; // Oldest intact record, moved before a record gets overwritten
+		};
+		
+		// Records are 8 byte aligned. A record never wraps around, if it doesn't fit before the end of
+		// the ring a padding record fills the rest, if not even the header fits the rest is skipped
+		struct record_header
+		{
+			uint32_t size; // Including the header and padding
+			uint32_t length; // Of the text following the header
+			uint64_t sequence;
+			int64_t time; // Nanoseconds since the system clock epoch
+			int32_t level;
+			uint32_t flags;
+		};
+		
+		struct entry
+		{
+			log_level level;
+			uint64_t sequence;
+			std::chrono::system_clock::time_point time;
+			const char *text;
+			size_t length;
+		};
+		
+		// The capacity is rounded up to a multiple of the page size. An existing ring of the same capacity is continued
+		mmap_logging_engine(const std::string& path, size_t capacity = 16 * 1024 * 1024);
+		~mmap_logging_engine() override;
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+		// Calls the callback for every intact record in the file, oldest first. Returns false if the file isn't a valid ring
+		static bool read(const std::string& path, const std::function<void (const entry&)>& callback);
+		
+	private:
+		void reserve(uint64_t size);
+		
+		int _fd;
+		char *_mapping;
+		size_t _mapping_size;
+		
+		file_header *_header;
+		char *_ring;
+		uint64_t _capacity;
+	};
+}
+
+#endif /* _RATATOSKR_MMAPLOGGINGENGINE_H_ */
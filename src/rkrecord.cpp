@@ -0,0 +1,535 @@
+//
+//  rkrecord.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "rkrecord.h"
+#include "rkdescriptor.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	template<class T>
+	T read_value(const char *&data)
+	{
+		T val;
+		
+		std::memcpy(&val, data, sizeof(T));
+		data += sizeof(T);
+		
+		return val;
+	}
+	
+	// Output of render_emergency(), silently drops everything past its capacity
+	struct fixed_output
+	{
+		char *data;
+		size_t size;
+		size_t capacity;
+		
+		void append(const char *text, size_t length)
+		{
+			length = std::min(length, capacity - size);
+			
+			std::memcpy(data + size, text, length);
+			size += length;
+		}
+		
+		void push_back(char c)
+		{
+			if(size < capacity)
+				data[size ++] = c;
+		}
+		
+		void append_unsigned(unsigned long long val)
+		{
+			char digits[20];
+			char *first = formatter::write_decimal(digits + 20, val);
+			
+			append(first, static_cast<size_t>(digits + 20 - first));
+		}
+		
+		void append_signed(long long val)
+		{
+			if(val < 0)
+			{
+				push_back('-');
+				append_unsigned(static_cast<unsigned long long>(0) - static_cast<unsigned long long>(val));
+				return;
+			}
+			
+			append_unsigned(static_cast<unsigned long long>(val));
+		}
+		
+		void append_pointer(const void *val)
+		{
+			uintptr_t address = reinterpret_cast<uintptr_t>(val);
+			
+			char digits[2 * sizeof(uintptr_t)];
+			char *first = digits + sizeof(digits);
+			
+			do {
+				*(-- first) = "0123456789abcdef"[address & 0xf];
+				address >>= 4;
+			} while(address);
+			
+			append("0x", 2);
+			append(first, static_cast<size_t>(digits + sizeof(digits) - first));
+		}
+		
+		void append_double(double val)
+		{
+			if(val != val)
+			{
+				append("nan", 3);
+				return;
+			}
+			
+			if(val < 0.0)
+			{
+				push_back('-');
+				val = -val;
+			}
+			
+			// Values that don't fit the integer conversion only get their magnitude
+			if(val >= 1e18)
+			{
+				if(val > 1.7976931348623157e308)
+				{
+					append("inf", 3);
+					return;
+				}
+				
+				int exponent = 0;
+				
+				while(val >= 10.0)
+				{
+					val /= 10.0;
+					exponent ++;
+				}
+				
+				append_unsigned(static_cast<unsigned long long>(val));
+				append("e+", 2);
+				append_unsigned(static_cast<unsigned long long>(exponent));
+				return;
+			}
+			
+			unsigned long long integral = static_cast<unsigned long long>(val);
+			unsigned long long fraction = static_cast<unsigned long long>((val - static_cast<double>(integral)) * 1000000.0 + 0.5);
+			
+			if(fraction >= 1000000)
+			{
+				integral ++;
+				fraction -= 1000000;
+			}
+			
+			append_unsigned(integral);
+			
+			if(fraction > 0)
+			{
+				char digits[7];
+				
+				digits[0] = '.';
+				formatter::write_decimal(digits + 1, static_cast<unsigned int>(fraction), 6);
+				
+				size_t length = 7;
+				while(digits[length - 1] == '0')
+					length --;
+				
+				append(digits, length);
+			}
+		}
+	};
+	
+	const char *render_emergency_argument(fixed_output& output, const char *data)
+	{
+		typedef record::type type;
+		
+		type tag = static_cast<type>(*data ++);
+		
+		switch(tag)
+		{
+			case type::string:
+			{
+				size_t length = read_value<size_t>(data);
+				
+				output.append(data, length);
+				data += length;
+				break;
+			}
+			case type::character:
+				output.push_back(read_value<char>(data));
+				break;
+			case type::boolean:
+				output.push_back(read_value<bool>(data) ? '1' : '0');
+				break;
+			case type::short_integer:
+				output.append_signed(read_value<short>(data));
+				break;
+			case type::unsigned_short_integer:
+				output.append_unsigned(read_value<unsigned short>(data));
+				break;
+			case type::integer:
+				output.append_signed(read_value<int>(data));
+				break;
+			case type::unsigned_integer:
+				output.append_unsigned(read_value<unsigned int>(data));
+				break;
+			case type::long_integer:
+				output.append_signed(read_value<long>(data));
+				break;
+			case type::unsigned_long_integer:
+				output.append_unsigned(read_value<unsigned long>(data));
+				break;
+			case type::long_long_integer:
+				output.append_signed(read_value<long long>(data));
+				break;
+			case type::unsigned_long_long_integer:
+				output.append_unsigned(read_value<unsigned long long>(data));
+				break;
+			case type::floating_point:
+				output.append_double(read_value<double>(data));
+				break;
+			case type::pointer:
+				output.append_pointer(read_value<const void *>(data));
+				break;
+			case type::stream_manipulator:
+				data += sizeof(record::stream_manipulator);
+				break;
+			case type::ios_manipulator:
+				data += sizeof(record::ios_manipulator);
+				break;
+			case type::ios_base_manipulator:
+				data += sizeof(record::ios_base_manipulator);
+				break;
+		}
+		
+		return data;
+	}
+}
+
+void record::append(const char *val)
+{
+	if(val)
+		append_string(val, std::strlen(val));
+}
+
+void record::append_string(const char *val, size_t length)
+{
+	append_value(type::string, length);
+	_data.append(val, length);
+}
+
+void record::append_field_key(const char *key, field_type tag)
+{
+	size_t length = std::min<size_t>(std::strlen(key), 255);
+	char *data = _fields.reserve(2 + length);
+	
+	data[0] = static_cast<char>(length);
+	std::memcpy(data + 1, key, length);
+	data[1 + length] = static_cast<char>(tag);
+	
+	_fields.commit(2 + length);
+}
+
+void record::add_field_string(const char *key, const char *val, size_t length)
+{
+	uint32_t size = static_cast<uint32_t>(std::min<size_t>(length, UINT32_MAX));
+	
+	add_field_value(key, field_type::string, size);
+	_fields.append(val, size);
+}
+
+const char *record::read_field(const char *data, field& field)
+{
+	field.key_length = static_cast<uint8_t>(*data ++);
+	field.key = data;
+	data += field.key_length;
+	
+	field.type = static_cast<field_type>(*data ++);
+	field.string = nullptr;
+	field.length = 0;
+	
+	switch(field.type)
+	{
+		case field_type::integer:
+			field.integer = read_value<int64_t>(data);
+			break;
+		case field_type::unsigned_integer:
+			field.unsigned_integer = read_value<uint64_t>(data);
+			break;
+		case field_type::floating_point:
+			field.floating_point = read_value<double>(data);
+			break;
+		case field_type::boolean:
+			field.boolean = (read_value<uint8_t>(data) != 0);
+			break;
+		case field_type::string:
+			field.length = read_value<uint32_t>(data);
+			field.string = data;
+			data += field.length;
+			break;
+	}
+	
+	return data;
+}
+
+const char *record::render_argument(formatter& formatter, buffer& output, const char *data) const
+{
+	type tag = static_cast<type>(*data ++);
+	
+	switch(tag)
+	{
+		case type::string:
+		{
+			size_t length = read_value<size_t>(data);
+			
+			formatter.format(output, data, length);
+			data += length;
+			break;
+		}
+		case type::character:
+			formatter.format(output, read_value<char>(data));
+			break;
+		case type::boolean:
+			formatter.format(output, read_value<bool>(data));
+			break;
+		case type::short_integer:
+			formatter.format(output, read_value<short>(data));
+			break;
+		case type::unsigned_short_integer:
+			formatter.format(output, read_value<unsigned short>(data));
+			break;
+		case type::integer:
+			formatter.format(output, read_value<int>(data));
+			break;
+		case type::unsigned_integer:
+			formatter.format(output, read_value<unsigned int>(data));
+			break;
+		case type::long_integer:
+			formatter.format(output, read_value<long>(data));
+			break;
+		case type::unsigned_long_integer:
+			formatter.format(output, read_value<unsigned long>(data));
+			break;
+		case type::long_long_integer:
+			formatter.format(output, read_value<long long>(data));
+			break;
+		case type::unsigned_long_long_integer:
+			formatter.format(output, read_value<unsigned long long>(data));
+			break;
+		case type::floating_point:
+			formatter.format(output, read_value<double>(data));
+			break;
+		case type::pointer:
+			formatter.format(output, read_value<const void *>(data));
+			break;
+		case type::stream_manipulator:
+			formatter.format(output, read_value<stream_manipulator>(data));
+			break;
+		case type::ios_manipulator:
+			formatter.format(output, read_value<ios_manipulator>(data));
+			break;
+		case type::ios_base_manipulator:
+			formatter.format(output, read_value<ios_base_manipulator>(data));
+			break;
+	}
+	
+	return data;
+}
+
+void record::render(buffer& output) const
+{
+	render_message(output);
+	render_fields(output);
+}
+
+void record::render_fields(buffer& output) const
+{
+	formatter formatter;
+	
+	for_each_field([&](const field& field) {
+		
+		if(!output.empty())
+			output.push_back(' ');
+		
+		output.append(field.key, field.key_length);
+		output.push_back('=');
+		
+		switch(field.type)
+		{
+			case field_type::integer:
+				formatter.format(output, static_cast<long long>(field.integer));
+				break;
+			case field_type::unsigned_integer:
+				formatter.format(output, static_cast<unsigned long long>(field.unsigned_integer));
+				break;
+			case field_type::floating_point:
+				formatter.format(output, field.floating_point);
+				break;
+			case field_type::boolean:
+				formatter.format(output, field.boolean);
+				break;
+			case field_type::string:
+				output.append(field.string, field.length);
+				break;
+		}
+	});
+}
+
+void record::render_message(buffer& output) const
+{
+	if(_text)
+	{
+		output.append(_data);
+		return;
+	}
+	
+	const char *data = _data.data();
+	const char *end  = data + _data.size();
+	
+	formatter formatter;
+	
+	const descriptor *site = descriptor::get_descriptor(_descriptor);
+	
+	if(site)
+	{
+		// The placeholder count was checked at compile time, but stay safe in case it doesn't match
+		const char *format = site->get_format();
+		
+		while(*format)
+		{
+			if((format[0] == '{' && format[1] == '{') || (format[0] == '}' && format[1] == '}'))
+			{
+				output.push_back(format[0]);
+				format += 2;
+				continue;
+			}
+			
+			if(format[0] == '{' && format[1] == '}')
+			{
+				if(data < end)
+					data = render_argument(formatter, output, data);
+				
+				format += 2;
+				continue;
+			}
+			
+			const char *literal = format;
+			
+			while(*format && *format != '{' && *format != '}')
+				format ++;
+			
+			if(format == literal)
+				format ++;
+			
+			output.append(literal, format - literal);
+		}
+		
+		return;
+	}
+	
+	while(data < end)
+		data = render_argument(formatter, output, data);
+}
+
+size_t record::render_emergency(char *data, size_t capacity) const
+{
+	fixed_output output = { data, 0, capacity };
+	
+	const char *argument = _data.data();
+	const char *end = argument + _data.size();
+	
+	const descriptor *site = _text ? nullptr : descriptor::get_descriptor_nonblocking(_descriptor);
+	
+	if(_text)
+	{
+		output.append(argument, _data.size());
+	}
+	else if(site)
+	{
+		const char *format = site->get_format();
+		
+		while(*format)
+		{
+			if((format[0] == '{' && format[1] == '{') || (format[0] == '}' && format[1] == '}'))
+			{
+				output.push_back(format[0]);
+				format += 2;
+			}
+			else if(format[0] == '{' && format[1] == '}')
+			{
+				if(argument < end)
+					argument = render_emergency_argument(output, argument);
+				
+				format += 2;
+			}
+			else
+			{
+				output.push_back(*format ++);
+			}
+		}
+	}
+	else
+	{
+		while(argument < end)
+			argument = render_emergency_argument(output, argument);
+	}
+	
+	for_each_field([&](const field& field) {
+		
+		if(output.size > 0)
+			output.push_back(' ');
+		
+		output.append(field.key, field.key_length);
+		output.push_back('=');
+		
+		switch(field.type)
+		{
+			case field_type::integer:
+				output.append_signed(field.integer);
+				break;
+			case field_type::unsigned_integer:
+				output.append_unsigned(field.unsigned_integer);
+				break;
+			case field_type::floating_point:
+				output.append_double(field.floating_point);
+				break;
+			case field_type::boolean:
+				output.push_back(field.boolean ? '1' : '0');
+				break;
+			case field_type::string:
+				output.append(field.string, field.length);
+				break;
+		}
+	});
+	
+	return output.size;
+}
+
+std::string record::render() const
+{
+	if(_text && _fields.empty())
+		return std::string(_data.data(), _data.size());
+	
+	small_buffer<512> output;
+	render(output);
+	
+	return std::string(output.data(), output.size());
+}
@@ -0,0 +1,224 @@
+//
+//  rkrecord.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_RECORD_H_
+#define _RATATOSKR_RECORD_H_
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "rkbuffer.h"
+#include "rkformatter.h"
+
+namespace ratatoskr
+{
+	// Binary representation of a log message. Arguments are stored as a type tag followed by
+	// their raw bytes, turning them into text is deferred until render() gets called.
+	// Records created by the rklog() macros also reference the descriptor of their call site,
+	// in which case the arguments get substituted into the descriptors format string.
+	// Alternatively a record can hold text that was already rendered, see text().
+	// Independent of that a record can carry typed key/value fields, which are kept in a separate block
+	// that uses the same encoding as the binary wire format, so engines can write it out without conversion.
+	class record
+	{
+	public:
+		typedef formatter::stream_manipulator stream_manipulator;
+		typedef formatter::ios_manipulator ios_manipulator;
+		typedef formatter::ios_base_manipulator ios_base_manipulator;
+		
+		// Records up to this size don't allocate
+		static const size_t inline_capacity = 128;
+		
+		enum class type : uint8_t
+		{
+			string,
+			character,
+			boolean,
+			short_integer,
+			unsigned_short_integer,
+			integer,
+			unsigned_integer,
+			long_integer,
+			unsigned_long_integer,
+			long_long_integer,
+			unsigned_long_long_integer,
+			floating_point,
+			pointer,
+			stream_manipulator,
+			ios_manipulator,
+			ios_base_manipulator
+		};
+		
+		// Field values are normalized to a handful of fixed width types, so their encoding doesn't depend on the platform
+		enum class field_type : uint8_t
+		{
+			integer = 1,
+			unsigned_integer = 2,
+			floating_point = 3,
+			boolean = 4,
+			string = 5
+		};
+		
+		// A decoded field. Key and string values point into the record
+		struct field
+		{
+			const char *key;
+			size_t key_length;
+			field_type type;
+			
+			union
+			{
+				int64_t integer;
+				uint64_t unsigned_integer;
+				double floating_point;
+				bool boolean;
+			};
+			
+			const char *string;
+			size_t length;
+		};
+		
+		record() :
+			_descriptor(0),
+			_text(false)
+		{}
+		
+		explicit record(uint32_t descriptor) :
+			_descriptor(descriptor),
+			_text(false)
+		{}
+		
+		void append(const std::string& val) { append_string(val.data(), val.size()); }
+		void append(const char *val);
+		void append(char val) { append_value(type::character, val); }
+		void append(bool val) { append_value(type::boolean, val); }
+		void append(short val) { append_value(type::short_integer, val); }
+		void append(unsigned short val) { append_value(type::unsigned_short_integer, val); }
+		void append(int val) { append_value(type::integer, val); }
+		void append(unsigned int val) { append_value(type::unsigned_integer, val); }
+		void append(long val) { append_value(type::long_integer, val); }
+		void append(unsigned long val) { append_value(type::unsigned_long_integer, val); }
+		void append(long long val) { append_value(type::long_long_integer, val); }
+		void append(unsigned long long val) { append_value(type::unsigned_long_long_integer, val); }
+		void append(float val) { append_value(type::floating_point, static_cast<double>(val)); }
+		void append(double val) { append_value(type::floating_point, val); }
+		void append(const void *val) { append_value(type::pointer, val); }
+		void append(stream_manipulator val) { append_value(type::stream_manipulator, val); }
+		void append(ios_manipulator val) { append_value(type::ios_manipulator, val); }
+		void append(ios_base_manipulator val) { append_value(type::ios_base_manipulator, val); }
+		
+		// Keys longer than 255 bytes get truncated
+		void add_field(const char *key, const std::string& val) { add_field_string(key, val.data(), val.size()); }
+		void add_field(const char *key, const char *val) { add_field_string(key, val ? val : "", val ? std::strlen(val) : 0); }
+		void add_field(const char *key, char val) { add_field_string(key, &val, 1); }
+		void add_field(const char *key, bool val) { add_field_value(key, field_type::boolean, static_cast<uint8_t>(val)); }
+		void add_field(const char *key, short val) { add_field_value(key, field_type::integer, static_cast<int64_t>(val)); }
+		void add_field(const char *key, unsigned short val) { add_field_value(key, field_type::unsigned_integer, static_cast<uint64_t>(val)); }
+		void add_field(const char *key, int val) { add_field_value(key, field_type::integer, static_cast<int64_t>(val)); }
+		void add_field(const char *key, unsigned int val) { add_field_value(key, field_type::unsigned_integer, static_cast<uint64_t>(val)); }
+		void add_field(const char *key, long val) { add_field_value(key, field_type::integer, static_cast<int64_t>(val)); }
+		void add_field(const char *key, unsigned long val) { add_field_value(key, field_type::unsigned_integer, static_cast<uint64_t>(val)); }
+		void add_field(const char *key, long long val) { add_field_value(key, field_type::integer, static_cast<int64_t>(val)); }
+		void add_field(const char *key, unsigned long long val) { add_field_value(key, field_type::unsigned_integer, static_cast<uint64_t>(val)); }
+		void add_field(const char *key, float val) { add_field_value(key, field_type::floating_point, static_cast<double>(val)); }
+		void add_field(const char *key, double val) { add_field_value(key, field_type::floating_point, val); }
+		
+		bool has_fields() const { return !_fields.empty(); }
+		
+		// The encoded fields, each one is a one byte key length, the key, a field_type byte and the value.
+		// Numbers are stored as 8 byte little endian values, booleans as a single byte and strings as a
+		// 4 byte length followed by the bytes
+		const buffer& get_fields() const { return _fields; }
+		
+		// Calls the function with a const field& for every field, in the order they were added
+		template<class F>
+		void for_each_field(F&& function) const
+		{
+			const char *data = _fields.data();
+			const char *end = data + _fields.size();
+			
+			field field;
+			
+			while(data < end)
+			{
+				data = read_field(data, field);
+				function(static_cast<const struct field&>(field));
+			}
+		}
+		
+		// Turns the record into a plain text record and returns the text for writing. Can't be mixed with append()
+		buffer& text() { _text = true; return _data; }
+		const buffer& text() const { return _data; }
+		bool is_text() const { return _text; }
+		
+		// Renders the message followed by the fields as key=value pairs
+		void render(buffer& output) const;
+		std::string render() const;
+		
+		// Renders only the message, without the fields
+		void render_message(buffer& output) const;
+		void render_fields(buffer& output) const;
+		
+		// Renders the message and the fields into the given storage, cutting off whatever doesn't fit, and returns the length.
+		// Only uses async-signal-safe operations, so it can run in a crash handler. Manipulators are ignored and floating
+		// point values are written in fixed notation with up to six decimals, since the formatter relies on snprintf()
+		size_t render_emergency(char *output, size_t capacity) const;
+		
+		uint32_t get_descriptor() const { return _descriptor; }
+		
+		bool empty() const { return (_data.empty() && _fields.empty() && _descriptor == 0); }
+		void clear() { _data.clear(); _fields.clear(); _descriptor = 0; _text = false; }
+		
+		static const char *read_field(const char *data, field& field);
+		
+	private:
+		void append_string(const char *val, size_t length);
+		void append_field_key(const char *key, field_type tag);
+		void add_field_string(const char *key, const char *val, size_t length);
+		const char *render_argument(formatter& formatter, buffer& output, const char *data) const;
+		
+		template<class T>
+		void append_value(type tag, T val)
+		{
+			char *data = _data.reserve(1 + sizeof(T));
+			
+			data[0] = static_cast<char>(tag);
+			std::memcpy(data + 1, &val, sizeof(T));
+			
+			_data.commit(1 + sizeof(T));
+		}
+		
+		template<class T>
+		void add_field_value(const char *key, field_type tag, T val)
+		{
+			append_field_key(key, tag);
+			
+			char *data = _fields.reserve(sizeof(T));
+			std::memcpy(data, &val, sizeof(T));
+			
+			_fields.commit(sizeof(T));
+		}
+		
+		uint32_t _descriptor;
+		bool _text;
+		small_buffer<inline_capacity> _data;
+		small_buffer<64> _fields;
+	};
+}
+
+#endif /* _RATATOSKR_RECORD_H_ */
@@ -0,0 +1,145 @@
+//
+//  rkringbuffer.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_RINGBUFFER_H_
+#define _RATATOSKR_RINGBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ratatoskr
+{
+	// Bounded single producer, single consumer queue. push() may only be called from one
+	// thread and front()/pop() only from one (other) thread, neither side ever blocks.
+	template<class T>
+	class ringbuffer
+	{
+	public:
+		ringbuffer(size_t capacity) :
+			_head(0),
+			_cached_tail(0),
+			_tail(0),
+			_cached_head(0)
+		{
+			_capacity = 1;
+			while(_capacity < capacity)
+				_capacity <<= 1;
+			
+			_mask = _capacity - 1;
+			_storage = new storage[_capacity];
+		}
+		
+		~ringbuffer()
+		{
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			size_t head = _head.load(std::memory_order_relaxed);
+			
+			for(; tail != head; tail ++)
+				slot(tail)->~T();
+			
+			delete[] _storage;
+		}
+		
+		ringbuffer(const ringbuffer&) = delete;
+		ringbuffer& operator= (const ringbuffer&) = delete;
+		
+		// Producer side
+		bool full()
+		{
+			size_t head = _head.load(std::memory_order_relaxed);
+			
+			if(head - _cached_tail < _capacity)
+				return false;
+			
+			_cached_tail = _tail.load(std::memory_order_acquire);
+			return (head - _cached_tail >= _capacity);
+		}
+		
+		bool push(T&& value)
+		{
+			if(full())
+				return false;
+			
+			size_t head = _head.load(std::memory_order_relaxed);
+			
+			new(slot(head)) T(std::move(value));
+			_head.store(head + 1, std::memory_order_release);
+			
+			return true;
+		}
+		
+		// Consumer side, the oldest element or nullptr if the queue is empty, stays valid until the next pop()
+		T *front()
+		{
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			
+			if(tail == _cached_head)
+			{
+				_cached_head = _head.load(std::memory_order_acquire);
+				if(tail == _cached_head)
+					return nullptr;
+			}
+			
+			return slot(tail);
+		}
+		
+		// Discards the element returned by front()
+		void pop()
+		{
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			
+			slot(tail)->~T();
+			_tail.store(tail + 1, std::memory_order_release);
+		}
+		
+		// Safe to call from either side, but only a snapshot
+		size_t size() const
+		{
+			return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire));
+		}
+		
+		size_t capacity() const { return _capacity; }
+		
+		// Read only access for crash reports, which can't wait for the consumer. Positions are absolute, everything from
+		// get_tail() up to get_head() is queued, but only reliably so if the consumer doesn't pop at the same time
+		size_t get_tail() const { return _tail.load(std::memory_order_acquire); }
+		size_t get_head() const { return _head.load(std::memory_order_acquire); }
+		const T *peek(size_t position) const { return reinterpret_cast<const T *>(&_storage[position & _mask]); }
+		
+	private:
+		typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		
+		T *slot(size_t index) { return reinterpret_cast<T *>(&_storage[index & _mask]); }
+		
+		// Keep the producer and consumer indices on separate cache lines
+		alignas(64) std::atomic<size_t> _head;
+		size_t _cached_tail;
+		
+		alignas(64) std::atomic<size_t> _tail;
+		size_t _cached_head;
+		
+		alignas(64) size_t _capacity;
+		size_t _mask;
+		storage *_storage;
+	};
+}
+
+#endif /* _RATATOSKR_RINGBUFFER_H_ */
@@ -0,0 +1,132 @@
+//
+//  rkscheduler.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include "rkscheduler.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	const double __decay = 0.95; // Per flush, so the estimates follow changes in the workload within a few dozen flushes
+	const size_t __min_batch_size = 64;
+	const int64_t __min_interval = 1000; // Microseconds
+}
+
+flush_scheduler::flush_scheduler() :
+	_latency(100000),
+	_throughput(0),
+	_interval(100000),
+	_batch_size(1024),
+	_rate(0.0),
+	_last_update(std::chrono::steady_clock::now()),
+	_duration_index(0),
+	_weight(0.0),
+	_sum_count(0.0),
+	_sum_duration(0.0),
+	_sum_count_squared(0.0),
+	_sum_count_duration(0.0)
+{
+	std::fill(_durations, _durations + history, 0);
+}
+
+
+void flush_scheduler::set_targets(std::chrono::microseconds latency, size_t throughput)
+{
+	int64_t target = std::max<int64_t>(latency.count(), __min_interval);
+	
+	_latency.store(target, std::memory_order_relaxed);
+	_throughput.store(throughput, std::memory_order_relaxed);
+	
+	// Don't make a shorter target wait for the current interval to run out
+	if(_interval.load(std::memory_order_relaxed) > target)
+		_interval.store(target, std::memory_order_relaxed);
+}
+
+void flush_scheduler::update(size_t count, std::chrono::steady_clock::duration duration, size_t capacity)
+{
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - _last_update).count();
+	
+	_last_update = now;
+	
+	if(elapsed > 0.0)
+	{
+		double rate = static_cast<double>(count) / elapsed;
+		_rate.store(_rate.load(std::memory_order_relaxed) * __decay + rate * (1.0 - __decay), std::memory_order_relaxed);
+	}
+	
+	int64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+	
+	_durations[_duration_index] = microseconds;
+	_duration_index = (_duration_index + 1) % history;
+	
+	double n = static_cast<double>(count);
+	double d = static_cast<double>(microseconds);
+	
+	_weight = _weight * __decay + 1.0;
+	_sum_count = _sum_count * __decay + n;
+	_sum_duration = _sum_duration * __decay + d;
+	_sum_count_squared = _sum_count_squared * __decay + n * n;
+	_sum_count_duration = _sum_count_duration * __decay + n * d;
+	
+	// Interval: the target latency minus the slowest recent flush, but short enough that the
+	// queues don't fill up at the current arrival rate
+	int64_t latency = _latency.load(std::memory_order_relaxed);
+	int64_t slowest = *std::max_element(_durations, _durations + history);
+	int64_t floor = std::max(latency / 10, __min_interval);
+	int64_t interval = std::max(latency - slowest, floor);
+	
+	double arrival_rate = _rate.load(std::memory_order_relaxed);
+	
+	if(arrival_rate > 0.0)
+	{
+		double fill_time = static_cast<double>(capacity / 2) / arrival_rate * 1e6;
+		interval = std::max(std::min(interval, static_cast<int64_t>(fill_time)), __min_interval);
+	}
+	
+	_interval.store(interval, std::memory_order_relaxed);
+	
+	// Batch size: what arrives within one interval, so only a burst triggers an early flush. With a
+	// throughput target, large enough to amortize the per flush overhead at that throughput
+	size_t batch_size = capacity / 4;
+	size_t throughput = _throughput.load(std::memory_order_relaxed);
+	
+	if(arrival_rate > 0.0)
+		batch_size = static_cast<size_t>(std::min(arrival_rate * static_cast<double>(interval) / 1e6, static_cast<double>(capacity)));
+	
+	if(throughput > 0 && _weight > 1.0)
+	{
+		double mean_count = _sum_count / _weight;
+		double mean_duration = _sum_duration / _weight;
+		double variance = _sum_count_squared / _weight - mean_count * mean_count;
+		
+		double cost = (variance > 0.0) ? std::max((_sum_count_duration / _weight - mean_count * mean_duration) / variance, 0.0) : 0.0;
+		double overhead = std::max(mean_duration - cost * mean_count, 0.0);
+		
+		// Microseconds of work per second of messages, at or above 1e6 the engines can't keep up no matter the batch size
+		double load = cost * static_cast<double>(throughput);
+		
+		if(load >= 1e6)
+			batch_size = capacity / 2;
+		else
+			batch_size = std::max(batch_size, static_cast<size_t>(static_cast<double>(throughput) * overhead / (1e6 - load)));
+	}
+	
+	_batch_size.store(std::max(std::min(batch_size, capacity / 2), std::min(__min_batch_size, capacity)), std::memory_order_relaxed);
+}
@@ -0,0 +1,77 @@
+//
+//  rkscheduler.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_SCHEDULER_H_
+#define _RATATOSKR_SCHEDULER_H_
+
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace ratatoskr
+{
+	// Picks the flush interval and the number of queued messages that triggers an early flush from what it observes.
+	// The interval leaves enough room for the slowest recent flushes to still deliver within the target
+	// latency and shrinks if the queues would fill up before it ends. The batch size follows the arrival
+	// rate and grows until the per flush overhead allows for the target throughput.
+	// update() has to be called from one thread at a time, the getters can be called from anywhere.
+	class flush_scheduler
+	{
+	public:
+		flush_scheduler();
+		
+		// A throughput of 0 means there is no throughput target
+		void set_targets(std::chrono::microseconds latency, size_t throughput);
+		
+		std::chrono::microseconds get_latency_target() const { return std::chrono::microseconds(_latency.load(std::memory_order_relaxed)); }
+		size_t get_throughput_target() const { return _throughput.load(std::memory_order_relaxed); }
+		
+		// Records a flush of count messages that took duration to write, capacity is that of all queues combined
+		void update(size_t count, std::chrono::steady_clock::duration duration, size_t capacity);
+		
+		std::chrono::microseconds get_interval() const { return std::chrono::microseconds(_interval.load(std::memory_order_relaxed)); }
+		size_t get_batch_size() const { return _batch_size.load(std::memory_order_relaxed); }
+		double get_arrival_rate() const { return _rate.load(std::memory_order_relaxed); } // Messages per second
+		
+	private:
+		static const size_t history = 128;
+		
+		std::atomic<int64_t> _latency;
+		std::atomic<size_t> _throughput;
+		
+		std::atomic<int64_t> _interval;
+		std::atomic<size_t> _batch_size;
+		std::atomic<double> _rate;
+		
+		std::chrono::steady_clock::time_point _last_update;
+		
+		// Durations of the most recent flushes, their maximum stands in for the 99th percentile
+		int64_t _durations[history];
+		size_t _duration_index;
+		
+		// Exponentially weighted least squares fit of duration = overhead + cost * count
+		double _weight;
+		double _sum_count;
+		double _sum_duration;
+		double _sum_count_squared;
+		double _sum_count_duration;
+	};
+}
+
+#endif /* _RATATOSKR_SCHEDULER_H_ */
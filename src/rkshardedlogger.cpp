@@ -0,0 +1,62 @@
+//
+//  rkshardedlogger.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include "rkshardedlogger.h"
+
+using namespace ratatoskr;
+
+static std::atomic<uint64_t> __sharded_logger_id(0);
+
+namespace
+{
+	// Shard of every sharded logger the thread has logged to, by id. Ids are never reused, so entries of
+	// destroyed sharded loggers are never looked up again
+	thread_local std::vector<std::pair<uint64_t, size_t>> __shard_cache;
+}
+
+sharded_logger::sharded_logger(size_t shards) :
+	_id(__sharded_logger_id.fetch_add(1)),
+	_next_shard(0)
+{
+	shards = std::max(shards, static_cast<size_t>(1));
+	_shards.reserve(shards);
+	
+	for(size_t i = 0; i < shards; i ++)
+		_shards.emplace_back(new logger());
+}
+
+logger& sharded_logger::get_current_shard()
+{
+	for(auto& entry : __shard_cache)
+	{
+		if(entry.first == _id)
+			return *_shards[entry.second];
+	}
+	
+	size_t index = _next_shard.fetch_add(1, std::memory_order_relaxed) % _shards.size();
+	__shard_cache.emplace_back(_id, index);
+	
+	return *_shards[index];
+}
+
+void sharded_logger::flush(bool wait)
+{
+	for(auto& shard : _shards)
+		shard->flush(wait);
+}
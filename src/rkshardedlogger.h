@@ -0,0 +1,63 @@
+//
+//  rkshardedlogger.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_SHARDEDLOGGER_H_
+#define _RATATOSKR_SHARDEDLOGGER_H_
+
+#include <vector>
+#include <memory>
+#include "rklogger.h"
+
+namespace ratatoskr
+{
+	// A set of independent loggers, each thread logs into one of them. Threads get assigned round robin on their first
+	// message, so the producers and the flush work are spread over several flush threads instead of one shared logger.
+	// Messages are only ordered within a shard, engines are added per shard via get_shard(). Each engine must belong
+	// to exactly one shard, the flush threads of different shards would otherwise call into it concurrently
+	class sharded_logger
+	{
+	public:
+		sharded_logger(size_t shards);
+		
+		size_t get_shard_count() const { return _shards.size(); }
+		logger& get_shard(size_t index) { return *_shards[index]; }
+		logger& get_current_shard();
+		
+		bool is_enabled(log_level level) { return get_current_shard().is_enabled(level); }
+		
+		void log(const message& message) { get_current_shard().log(message); }
+		void log(message&& message) { get_current_shard().log(std::move(message)); }
+		void log(log_level level, const std::string& message) { get_current_shard().log(level, message); }
+		void log(log_level level, std::string&& message) { get_current_shard().log(level, std::move(message)); }
+		
+		template<class ... Args>
+		void log(const descriptor& descriptor, const Args& ... args)
+		{
+			get_current_shard().log(descriptor, args...);
+		}
+		
+		void flush(bool wait = false);
+		
+	private:
+		uint64_t _id;
+		std::vector<std::unique_ptr<logger>> _shards;
+		std::atomic<size_t> _next_shard;
+	};
+}
+
+#endif /* _RATATOSKR_SHARDEDLOGGER_H_ */
@@ -25,9 +25,12 @@ namespace ratatoskr
 	class singleton
 	{
 	public:
+		// Created on first use rather than during static initialization, so it exists for everything that
+		// uses it from a static constructor, and outlives every static object that was constructed after it
 		static T *get_shared_instance()
 		{
-			return &_instance;
+			static T instance;
+			return &instance;
 		}
 		
 	protected:
@@ -36,13 +39,7 @@ namespace ratatoskr
 		
 		virtual ~singleton()
 		{}
-		
-	private:
-		static T _instance;
 	};
-	
-	template <typename T>
-	T singleton<T>::_instance;
 }
 
 #endif /* _RATATOSKR_SINGLETON_H_ */
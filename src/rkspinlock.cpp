@@ -0,0 +1,116 @@
+//
+//  rkspinlock.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include "rkspinlock.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#elif defined(__APPLE__)
+// Private, but it's what libc++ builds std::atomic::wait() on
+extern "C" int __ulock_wait(uint32_t operation, void *address, uint64_t value, uint32_t timeout);
+extern "C" int __ulock_wake(uint32_t operation, void *address, uint64_t wake_value);
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+using namespace ratatoskr;
+
+namespace
+{
+	// Spinning covers lock holders that are about to finish, roughly a few microseconds in total
+	const int __spin_rounds = 10;
+	const int __max_backoff = 64;
+	
+#if defined(__APPLE__)
+	const uint32_t __ulock_compare_and_wait = 1;
+	const uint32_t __ulock_no_errno = 0x01000000;
+#elif !defined(__linux__)
+	// Without a futex, parked threads wait on a condition variable picked by the address of the lock. Locks
+	// share them, so the waiters are all woken up and the ones of other locks go back to sleep
+	struct parking_lot
+	{
+		std::mutex lock;
+		std::condition_variable signal;
+	};
+	
+	parking_lot __parking_lots[16];
+	
+	parking_lot& get_parking_lot(const void *address)
+	{
+		return __parking_lots[(reinterpret_cast<uintptr_t>(address) / sizeof(uint32_t)) % 16];
+	}
+#endif
+}
+
+void adaptive_lock::lock_contended()
+{
+	int backoff = 1;
+	
+	for(int round = 0; round < __spin_rounds; round ++)
+	{
+		for(int i = 0; i < backoff; i ++)
+			detail::cpu_relax();
+		
+		if(_state.load(std::memory_order_relaxed) == 0)
+		{
+			uint32_t expected = 0;
+			
+			if(_state.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+				return;
+		}
+		
+		backoff = std::min(backoff * 2, __max_backoff);
+	}
+	
+	// Mark the lock as having waiters, so the holder knows it has to wake someone up. Since it's not known
+	// whether other threads are still parked, a thread that acquires the lock here keeps it marked as well
+	while(_state.exchange(2, std::memory_order_acquire) != 0)
+	{
+#if defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_state), FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+#elif defined(__APPLE__)
+		__ulock_wait(__ulock_compare_and_wait | __ulock_no_errno, &_state, 2, 0);
+#else
+		// unlock() clears the state before it takes the mutex to wake anyone, so checking the state
+		// under the mutex can't miss the wake up
+		parking_lot& lot = get_parking_lot(&_state);
+		std::unique_lock<std::mutex> guard(lot.lock);
+		
+		while(_state.load(std::memory_order_relaxed) == 2)
+			lot.signal.wait(guard);
+#endif
+	}
+}
+
+void adaptive_lock::wake()
+{
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(__APPLE__)
+	__ulock_wake(__ulock_compare_and_wait | __ulock_no_errno, &_state, 0);
+#else
+	parking_lot& lot = get_parking_lot(&_state);
+	
+	std::lock_guard<std::mutex> guard(lot.lock);
+	lot.signal.notify_all();
+#endif
+}
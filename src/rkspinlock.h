@@ -20,37 +20,91 @@
 #define _RATATOSKR_SPINLOCK_H_
 
 #include <atomic>
+#include <cstdint>
 
 namespace ratatoskr
 {
+	namespace detail
+	{
+		// Tells the CPU that this is a spin wait loop, which saves power and frees up resources for a hyper thread sibling
+		inline void cpu_relax()
+		{
+#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+			__asm__ __volatile__("yield");
+#endif
+		}
+	}
+	
+	// Busy waits until the lock is free, only suited for very short critical sections without oversubscription
 	class spinlock
 	{
 	public:
 		spinlock()
-		{}
+		{
+			_flag.clear();
+		}
 		
 		~spinlock()
 		{}
 		
 		void lock()
 		{
-			while(_flag.test_and_set())
-			{}
+			while(_flag.test_and_set(std::memory_order_acquire))
+				detail::cpu_relax();
 		}
 		
 		void unlock()
 		{
-			_flag.clear();
+			_flag.clear(std::memory_order_release);
 		}
 		
 		bool try_lock()
 		{
-			return (_flag.test_and_set() == false);
+			return (_flag.test_and_set(std::memory_order_acquire) == false);
 		}
 		
 	private:
 		std::atomic_flag _flag;
 	};
+	
+	// Drop in replacement for spinlock that doesn't burn the waiting threads time slice. Contended lock() calls
+	// spin for a short while with exponential backoff, and then park the thread (on a futex on Linux, __ulock_wait()
+	// on macOS, a condition variable elsewhere) until unlock() wakes it up. The uncontended path is a single compare and swap
+	class adaptive_lock
+	{
+	public:
+		adaptive_lock() :
+			_state(0)
+		{}
+		
+		void lock()
+		{
+			uint32_t expected = 0;
+			
+			if(!_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+				lock_contended();
+		}
+		
+		void unlock()
+		{
+			if(_state.exchange(0, std::memory_order_release) == 2)
+				wake();
+		}
+		
+		bool try_lock()
+		{
+			uint32_t expected = 0;
+			return _state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+		
+	private:
+		void lock_contended();
+		void wake();
+		
+		std::atomic<uint32_t> _state; // 0 is unlocked, 1 locked, 2 locked with threads that might be parked
+	};
 }
 
 #endif /* _RATATOSKR_SPINLOCK_H_ */
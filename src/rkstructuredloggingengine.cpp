@@ -0,0 +1,290 @@
+//
+//  rkstructuredloggingengine.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include "rkstructuredloggingengine.h"
+
+using namespace ratatoskr;
+
+namespace
+{
+	int64_t nanoseconds_since_epoch(std::chrono::system_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+	
+	const char *level_name(log_level level)
+	{
+		switch(level)
+		{
+			case log_level::debug:
+				return "debug";
+			case log_level::info:
+				return "info";
+			case log_level::warning:
+				return "warning";
+			case log_level::error:
+				return "error";
+			case log_level::critical:
+				return "critical";
+		}
+		
+		return "unknown";
+	}
+	
+	void append_string(buffer& output, const char *data, size_t length)
+	{
+		static const char hex[] = "0123456789abcdef";
+		
+		output.push_back('"');
+		
+		const char *end = data + length;
+		
+		while(data < end)
+		{
+			// Copy runs of characters that don't need escaping in one go
+			const char *run = data;
+			
+			while(data < end && static_cast<unsigned char>(*data) >= 0x20 && *data != '"' && *data != '\\')
+				data ++;
+			
+			output.append(run, data - run);
+			
+			if(data == end)
+				break;
+			
+			char c = *data ++;
+			
+			switch(c)
+			{
+				case '"':
+					output.append("\\\"", 2);
+					break;
+				case '\\':
+					output.append("\\\\", 2);
+					break;
+				case '\n':
+					output.append("\\n", 2);
+					break;
+				case '\r':
+					output.append("\\r", 2);
+					break;
+				case '\t':
+					output.append("\\t", 2);
+					break;
+				default:
+				{
+					char escaped[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+					output.append(escaped, 6);
+					break;
+				}
+			}
+		}
+		
+		output.push_back('"');
+	}
+}
+
+// ---------------------
+// MARK: -
+// MARK: binary_logging_engine
+// ---------------------
+
+binary_logging_engine::binary_logging_engine(std::ostream& stream) :
+	_stream(stream)
+{}
+
+
+bool binary_logging_engine::is_good() const
+{
+	return _stream.good();
+}
+
+void binary_logging_engine::flush()
+{
+	if(!_buffer.empty())
+	{
+		_stream.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+		_buffer.clear();
+	}
+	
+	_stream.flush();
+}
+
+void binary_logging_engine::finalize()
+{
+	flush();
+}
+
+void binary_logging_engine::write(const message& message)
+{
+	const buffer& fields = message.get_record().get_fields();
+	size_t message_length = message.get_message_length();
+	
+	record_header header;
+	
+	header.length = static_cast<uint32_t>(sizeof(record_header) + message_length + fields.size());
+	header.version = version;
+	header.level = static_cast<uint8_t>(message.get_level());
+	header.reserved = 0;
+	header.message_length = static_cast<uint32_t>(message_length);
+	header.fields_length = static_cast<uint32_t>(fields.size());
+	header.sequence = message.get_sequence();
+	header.time = nanoseconds_since_epoch(message.get_time());
+	
+	_buffer.append(reinterpret_cast<const char *>(&header), sizeof(record_header));
+	_buffer.append(message.get_text(), message_length);
+	_buffer.append(fields);
+}
+
+void binary_logging_engine::write_batch(const message_batch& batch)
+{
+	for(auto& message : batch)
+		write(message);
+}
+
+bool binary_logging_engine::read(std::istream& stream, const std::function<void (const entry&)>& callback)
+{
+	std::vector<char> data;
+	
+	while(true)
+	{
+		record_header header;
+		
+		if(!stream.read(reinterpret_cast<char *>(&header), sizeof(record_header)))
+			return (stream.gcount() == 0);
+		
+		if(header.version != version || header.length < sizeof(record_header) || header.length - sizeof(record_header) != static_cast<uint64_t>(header.message_length) + header.fields_length)
+			return false;
+		
+		data.resize(header.length - sizeof(record_header));
+		
+		if(!data.empty() && !stream.read(data.data(), static_cast<std::streamsize>(data.size())))
+			return false;
+		
+		entry entry;
+		
+		entry.level = static_cast<log_level>(header.level);
+		entry.sequence = header.sequence;
+		entry.time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(header.time)));
+		entry.message = data.data();
+		entry.message_length = header.message_length;
+		entry.fields = data.data() + header.message_length;
+		entry.fields_length = header.fields_length;
+		
+		callback(entry);
+	}
+}
+
+// ---------------------
+// MARK: -
+// MARK: json_logging_engine
+// ---------------------
+
+json_logging_engine::json_logging_engine(std::ostream& stream) :
+	_stream(stream)
+{}
+
+
+bool json_logging_engine::is_good() const
+{
+	return _stream.good();
+}
+
+void json_logging_engine::flush()
+{
+	if(!_buffer.empty())
+	{
+		_stream.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+		_buffer.clear();
+	}
+	
+	_stream.flush();
+}
+
+void json_logging_engine::finalize()
+{
+	flush();
+}
+
+void json_logging_engine::write(const message& message)
+{
+	formatter formatter;
+	
+	_buffer.append("{\"time\":\"", 9);
+	_timestamp.format(_buffer, message.get_time());
+	_buffer.push_back('"');
+	
+	_buffer.append(",\"level\":\"", 10);
+	_buffer.append(level_name(message.get_level()), std::strlen(level_name(message.get_level())));
+	
+	_buffer.append("\",\"sequence\":", 13);
+	formatter.format(_buffer, static_cast<unsigned long long>(message.get_sequence()));
+	
+	_buffer.append(",\"message\":", 11);
+	append_string(_buffer, message.get_text(), message.get_message_length());
+	
+	message.get_record().for_each_field([&](const record::field& field) {
+		
+		_buffer.push_back(',');
+		append_string(_buffer, field.key, field.key_length);
+		_buffer.push_back(':');
+		
+		switch(field.type)
+		{
+			case record::field_type::integer:
+				formatter.format(_buffer, static_cast<long long>(field.integer));
+				break;
+			case record::field_type::unsigned_integer:
+				formatter.format(_buffer, static_cast<unsigned long long>(field.unsigned_integer));
+				break;
+			case record::field_type::floating_point:
+			{
+				if(!std::isfinite(field.floating_point))
+				{
+					_buffer.append("null", 4);
+					break;
+				}
+				
+				char *data = _buffer.reserve(32);
+				_buffer.commit(static_cast<size_t>(snprintf(data, 32, "%.17g", field.floating_point)));
+				break;
+			}
+			case record::field_type::boolean:
+				if(field.boolean)
+					_buffer.append("true", 4);
+				else
+					_buffer.append("false", 5);
+				break;
+			case record::field_type::string:
+				append_string(_buffer, field.string, field.length);
+				break;
+		}
+	});
+	
+	_buffer.append("}\n", 2);
+}
+
+void json_logging_engine::write_batch(const message_batch& batch)
+{
+	for(auto& message : batch)
+		write(message);
+}
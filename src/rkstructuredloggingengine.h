@@ -0,0 +1,116 @@
+//
+//  rkstructuredloggingengine.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_STRUCTUREDLOGGINGENGINE_H_
+#define _RATATOSKR_STRUCTUREDLOGGINGENGINE_H_
+
+#include <iostream>
+#include <functional>
+#include <chrono>
+#include "rkloggingengine.h"
+#include "rkbuffer.h"
+
+namespace ratatoskr
+{
+	// Writes length prefixed binary records. Every record starts with a record_header, followed by the message
+	// text and the fields of the record exactly as they are encoded by record::get_fields(). All numbers
+	// are little endian. The stream should be opened in binary mode
+	class binary_logging_engine : public logging_engine
+	{
+	public:
+		static const uint8_t version = 1;
+		
+		struct record_header
+		{
+			uint32_t length; // Size of the whole record, including the header
+			uint8_t version;
+			uint8_t level;
+			uint16_t reserved;
+			uint32_t message_length;
+			uint32_t fields_length;
+			uint64_t sequence;
+			int64_t time; // Nanoseconds since the epoch
+		};
+		
+		struct entry
+		{
+			log_level level;
+			uint64_t sequence;
+			std::chrono::system_clock::time_point time;
+			
+			const char *message;
+			size_t message_length;
+			
+			const char *fields;
+			size_t fields_length;
+			
+			template<class F>
+			void for_each_field(F&& function) const
+			{
+				const char *data = fields;
+				const char *end = fields + fields_length;
+				
+				record::field field;
+				
+				while(data < end)
+				{
+					data = record::read_field(data, field);
+					function(static_cast<const record::field&>(field));
+				}
+			}
+		};
+		
+		binary_logging_engine(std::ostream& stream);
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+		// Calls the callback for every record in the stream, returns false if the stream ended in a truncated or malformed record
+		static bool read(std::istream& stream, const std::function<void (const entry&)>& callback);
+		
+	private:
+		std::ostream& _stream;
+		small_buffer<4096> _buffer;
+	};
+	
+	// Writes one JSON object per line, ie. {"time":"2013-11-15T10:24:03.123456Z","level":"info","sequence":12,"message":"Request done","status":200}
+	// Fields are written as members of the object, so their keys shouldn't collide with the fixed ones
+	class json_logging_engine : public logging_engine
+	{
+	public:
+		json_logging_engine(std::ostream& stream);
+		
+		bool is_good() const final;
+		void flush() final;
+		void finalize() final;
+		
+		void write(const message& message) final;
+		void write_batch(const message_batch& batch) final;
+		
+	private:
+		std::ostream& _stream;
+		timestamp_formatter _timestamp;
+		small_buffer<4096> _buffer;
+	};
+}
+
+#endif /* _RATATOSKR_STRUCTUREDLOGGINGENGINE_H_ */
@@ -0,0 +1,125 @@
+//
+//  rktelemetry.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "rktelemetry.h"
+
+using namespace ratatoskr;
+
+// ---------------------
+// MARK: -
+// MARK: histogram
+// ---------------------
+
+histogram::histogram() :
+	_counts(bucket_count, 0),
+	_count(0),
+	_min(UINT64_MAX),
+	_max(0),
+	_sum(0)
+{}
+
+void histogram::record(uint64_t value, uint64_t count)
+{
+	if(count == 0)
+		return;
+	
+	_counts[get_bucket(value)] += count;
+	_count += count;
+	_sum += value * count;
+	_min = std::min(_min, value);
+	_max = std::max(_max, value);
+}
+
+void histogram::merge(const histogram& other)
+{
+	for(size_t i = 0; i < bucket_count; i ++)
+		_counts[i] += other._counts[i];
+	
+	_count += other._count;
+	_sum += other._sum;
+	_min = std::min(_min, other._min);
+	_max = std::max(_max, other._max);
+}
+
+uint64_t histogram::get_percentile(double percentile) const
+{
+	if(_count == 0)
+		return 0;
+	
+	if(percentile <= 0.0)
+		return _min;
+	
+	uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(percentile, 100.0) / 100.0 * static_cast<double>(_count)));
+	uint64_t seen = 0;
+	
+	for(size_t i = 0; i < bucket_count; i ++)
+	{
+		seen += _counts[i];
+		
+		if(seen >= rank)
+			return std::min(get_bucket_limit(i), _max);
+	}
+	
+	return _max;
+}
+
+uint64_t histogram::get_bucket_limit(size_t bucket)
+{
+	if(bucket < 32)
+		return static_cast<uint64_t>(bucket);
+	
+	size_t shift = bucket / 16 - 1;
+	uint64_t lower = static_cast<uint64_t>(16 + bucket % 16) << shift;
+	
+	return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+// ---------------------
+// MARK: -
+// MARK: histogram_recorder
+// ---------------------
+
+histogram_recorder::histogram_recorder() :
+	_min(UINT64_MAX),
+	_max(0),
+	_sum(0)
+{
+	for(auto& count : _counts)
+		count.store(0, std::memory_order_relaxed);
+}
+
+histogram histogram_recorder::get_snapshot() const
+{
+	histogram result;
+	
+	for(size_t i = 0; i < histogram::bucket_count; i ++)
+	{
+		uint64_t count = _counts[i].load(std::memory_order_relaxed);
+		
+		result._counts[i] = count;
+		result._count += count;
+	}
+	
+	result._min = _min.load(std::memory_order_relaxed);
+	result._max = _max.load(std::memory_order_relaxed);
+	result._sum = _sum.load(std::memory_order_relaxed);
+	
+	return result;
+}
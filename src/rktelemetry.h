@@ -0,0 +1,184 @@
+//
+//  rktelemetry.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_TELEMETRY_H_
+#define _RATATOSKR_TELEMETRY_H_
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ratatoskr
+{
+	class logging_engine;
+	class descriptor;
+	
+	// Log-linear histogram in the spirit of HdrHistogram. Values below 32 get a bucket each, above that every power
+	// of two is split into 16 buckets, so any 64 bit value is kept with a relative error of at most 1/16
+	class histogram
+	{
+	public:
+		static const size_t bucket_count = 976;
+		
+		histogram();
+		
+		void record(uint64_t value, uint64_t count = 1);
+		void merge(const histogram& other);
+		
+		uint64_t get_count() const { return _count; }
+		uint64_t get_min() const { return _count ? _min : 0; }
+		uint64_t get_max() const { return _max; }
+		double get_mean() const { return _count ? static_cast<double>(_sum) / static_cast<double>(_count) : 0.0; }
+		
+		// Percentile between 0 and 100, reported as the highest value that falls into the same bucket
+		uint64_t get_percentile(double percentile) const;
+		
+		uint64_t get_bucket_count(size_t bucket) const { return _counts[bucket]; }
+		
+		static size_t get_bucket(uint64_t value)
+		{
+			if(value < 32)
+				return static_cast<size_t>(value);
+			
+			size_t shift = most_significant_bit(value) - 4;
+			return (shift + 1) * 16 + static_cast<size_t>((value >> shift) & 15);
+		}
+		
+		// Highest value that falls into the bucket
+		static uint64_t get_bucket_limit(size_t bucket);
+		
+	private:
+		friend class histogram_recorder;
+		
+		static size_t most_significant_bit(uint64_t value)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return static_cast<size_t>(63 - __builtin_clzll(value));
+#else
+			size_t bit = 0;
+			
+			while(value >>= 1)
+				bit ++;
+			
+			return bit;
+#endif
+		}
+		
+		std::vector<uint64_t> _counts;
+		uint64_t _count;
+		uint64_t _min;
+		uint64_t _max;
+		uint64_t _sum;
+	};
+	
+	// Lets one thread at a time record values, which is cheap since it doesn't need any read-modify-write atomics,
+	// while any thread can take a snapshot. Snapshots taken while values are recorded might be off by the last value
+	class histogram_recorder
+	{
+	public:
+		histogram_recorder();
+		
+		histogram_recorder(const histogram_recorder&) = delete;
+		histogram_recorder& operator= (const histogram_recorder&) = delete;
+		
+		void record(uint64_t value)
+		{
+			increment(_counts[histogram::get_bucket(value)], 1);
+			increment(_sum, value);
+			
+			if(value < _min.load(std::memory_order_relaxed))
+				_min.store(value, std::memory_order_relaxed);
+			if(value > _max.load(std::memory_order_relaxed))
+				_max.store(value, std::memory_order_relaxed);
+		}
+		
+		histogram get_snapshot() const;
+		
+	private:
+		static void increment(std::atomic<uint64_t>& counter, uint64_t value)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+		
+		std::atomic<uint64_t> _counts[histogram::bucket_count];
+		std::atomic<uint64_t> _min;
+		std::atomic<uint64_t> _max;
+		std::atomic<uint64_t> _sum;
+	};
+	
+	struct engine_telemetry
+	{
+		logging_engine *engine;
+		histogram write_time; // Nanoseconds per batch, including the engines flush()
+	};
+	
+	// Counters are totals since the logger was created, depths are the current values. Times are in nanoseconds
+	struct logger_telemetry
+	{
+		uint64_t messages; // Queued messages, messages discarded before they got queued aren't counted
+		uint64_t dropped;
+		uint64_t overflowed; // Messages that went to the overflow buffer because their threads queue was full
+		uint64_t blocked; // Times a thread waited for room in the overflow buffer
+		uint64_t lock_contentions; // Times a thread had to wait for the overflow buffer lock
+		uint64_t lock_wait;
+		
+		size_t queued; // Messages in the per thread queues
+		size_t overflow_depth;
+		size_t max_overflow_depth;
+		
+		uint64_t timed_flushes; // Flushes started because the flush interval ran out
+		uint64_t requested_flushes; // Flushes started by flush(), a thread reaching the batch threshold or a full queue
+		uint64_t threshold_triggers; // Messages that reached the batch threshold of their queue
+		
+		histogram latency; // From submission until the synchronous engines wrote the message, or it got handed to the asynchronous ones
+		histogram flush_time;
+		histogram batch_size; // Messages per flush
+		std::vector<engine_telemetry> engines;
+	};
+	
+	// The step of a log() call that took most of its time, other if no step accounts for at least half of it
+	enum class stall_cause
+	{
+		other, // The call itself, or the thread got preempted
+		registration, // First message of the thread, which allocates and registers its queue
+		lock_wait, // Waiting for the overflow buffer lock
+		allocation, // Growing the overflow buffer
+		signal, // Waking up the flush thread
+		blocked // Waiting for room in the overflow buffer
+	};
+	
+	struct call_site_latency
+	{
+		uint32_t descriptor_id; // 0 for messages that didn't come from rklog()
+		const descriptor *site; // Looked up from descriptor_id
+		uint64_t outliers;
+		uint64_t total; // Nanoseconds spent in outliers
+		uint64_t max;
+		uint64_t causes[static_cast<size_t>(stall_cause::blocked) + 1]; // Outliers by stall_cause
+	};
+	
+	struct latency_report
+	{
+		histogram calls; // Nanoseconds per log() call over all threads
+		std::vector<histogram> threads; // The same for every thread that is still logging
+		std::vector<call_site_latency> sites; // Call sites with outliers, most time spent in outliers first
+	};
+}
+
+#endif /* _RATATOSKR_TELEMETRY_H_ */
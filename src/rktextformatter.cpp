@@ -0,0 +1,139 @@
+//
+//  rktextformatter.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <limits>
+#include "rktextformatter.h"
+#include "rkformatter.h"
+#include "rkloggingengine.h"
+
+using namespace ratatoskr;
+
+// ---------------------
+// MARK: -
+// MARK: timestamp_formatter
+// ---------------------
+
+timestamp_formatter::timestamp_formatter() :
+	_second(std::numeric_limits<int64_t>::min())
+{}
+
+
+void timestamp_formatter::format(char *output, std::chrono::system_clock::time_point time)
+{
+	int64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	int64_t second = microseconds / 1000000;
+	int64_t fraction = microseconds % 1000000;
+	
+	if(fraction < 0)
+	{
+		second --;
+		fraction += 1000000;
+	}
+	
+	if(second != _second)
+		update_prefix(second);
+	
+	std::memcpy(output, _prefix, sizeof(_prefix));
+	formatter::write_decimal(output + sizeof(_prefix), static_cast<unsigned int>(fraction), 6);
+	output[length - 1] = 'Z';
+}
+
+void timestamp_formatter::format(buffer& output, std::chrono::system_clock::time_point time)
+{
+	format(output.reserve(length), time);
+	output.commit(length);
+}
+
+void timestamp_formatter::update_prefix(int64_t second)
+{
+	int64_t days = second / 86400;
+	int64_t time = second % 86400;
+	
+	if(time < 0)
+	{
+		days --;
+		time += 86400;
+	}
+	
+	// Converts days since the epoch into a proleptic Gregorian calendar date, without going through gmtime()
+	days += 719468;
+	
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	int64_t day_of_era = days - era * 146097;
+	int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	int64_t shifted_month = (5 * day_of_year + 2) / 153; // Starts with March
+	
+	unsigned int day = static_cast<unsigned int>(day_of_year - (153 * shifted_month + 2) / 5 + 1);
+	unsigned int month = static_cast<unsigned int>(shifted_month < 10 ? shifted_month + 3 : shifted_month - 9);
+	unsigned int year = static_cast<unsigned int>(year_of_era + era * 400 + (month <= 2 ? 1 : 0));
+	
+	formatter::write_decimal(_prefix, year, 4);
+	_prefix[4] = '-';
+	formatter::write_decimal(_prefix + 5, month, 2);
+	_prefix[7] = '-';
+	formatter::write_decimal(_prefix + 8, day, 2);
+	_prefix[10] = 'T';
+	formatter::write_decimal(_prefix + 11, static_cast<unsigned int>(time / 3600), 2);
+	_prefix[13] = ':';
+	formatter::write_decimal(_prefix + 14, static_cast<unsigned int>((time / 60) % 60), 2);
+	_prefix[16] = ':';
+	formatter::write_decimal(_prefix + 17, static_cast<unsigned int>(time % 60), 2);
+	_prefix[19] = '.';
+	
+	_second = second;
+}
+
+// ---------------------
+// MARK: -
+// MARK: line_formatter
+// ---------------------
+
+size_t line_formatter::format(char *output, const message& message)
+{
+	char *data = output;
+	
+	if(_timestamps.load(std::memory_order_relaxed))
+	{
+		_timestamp.format(data, message.get_time());
+		data[timestamp_formatter::length] = ' ';
+		
+		data += timestamp_formatter::length + 1;
+	}
+	
+	size_t length;
+	const char *level = logging_engine::translate_log_level(message.get_level(), length);
+	
+	std::memcpy(data, level, length);
+	data[length] = ' ';
+	data += length + 1;
+	
+	std::memcpy(data, message.get_text(), message.get_length());
+	data += message.get_length();
+	
+	*data ++ = '\n';
+	
+	return static_cast<size_t>(data - output);
+}
+
+void line_formatter::format(buffer& output, const message& message)
+{
+	char *data = output.reserve(get_max_length(message));
+	output.commit(format(data, message));
+}
@@ -0,0 +1,75 @@
+//
+//  rktextformatter.h
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RATATOSKR_TEXTFORMATTER_H_
+#define _RATATOSKR_TEXTFORMATTER_H_
+
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include "rkbuffer.h"
+#include "rklogger.h"
+
+namespace ratatoskr
+{
+	// Renders ISO-8601 UTC time stamps with microseconds, ie. 2013-11-15T10:24:03.123456Z. The date and time
+	// up to the second are cached, so consecutive messages only rewrite the sub second digits
+	class timestamp_formatter
+	{
+	public:
+		static const size_t length = 27;
+		
+		timestamp_formatter();
+		
+		// Writes exactly length bytes
+		void format(char *output, std::chrono::system_clock::time_point time);
+		void format(buffer& output, std::chrono::system_clock::time_point time);
+		
+	private:
+		void update_prefix(int64_t second);
+		
+		int64_t _second;
+		char _prefix[20]; // Everything up to and including the decimal point
+	};
+	
+	// Renders messages as lines of text, ie. "(info) Hello world\n" or with time stamps enabled
+	// "2013-11-15T10:24:03.123456Z (info) Hello world\n". Used by all text based engines
+	class line_formatter
+	{
+	public:
+		line_formatter() :
+			_timestamps(false)
+		{}
+		
+		void set_timestamps(bool timestamps) { _timestamps.store(timestamps, std::memory_order_relaxed); }
+		bool get_timestamps() const { return _timestamps.load(std::memory_order_relaxed); }
+		
+		// Upper bound of the bytes format() writes for the message
+		size_t get_max_length(const message& message) const { return timestamp_formatter::length + 8 + message.get_length() + 1; }
+		
+		// Returns the number of bytes written, the output needs room for get_max_length() bytes
+		size_t format(char *output, const message& message);
+		void format(buffer& output, const message& message);
+		
+	private:
+		std::atomic<bool> _timestamps;
+		timestamp_formatter _timestamp;
+	};
+}
+
+#endif /* _RATATOSKR_TEXTFORMATTER_H_ */
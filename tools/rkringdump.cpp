@@ -0,0 +1,65 @@
+//
+//  rkringdump.cpp
+//  ratatoskr
+//
+//  Created by Sidney Just
+//  Copyright (c) 2013 by Überpixel
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+// Prints the messages stored in a ring file written by mmap_logging_engine, oldest first:
+//   rkringdump path/to/ring
+
+#include <cstdio>
+#include <ctime>
+#include "ratatoskr.h"
+
+int main(int argc, const char *argv[])
+{
+	if(argc != 2)
+	{
+		std::fprintf(stderr, "usage: %s <ring file>\n", argv[0]);
+		return 1;
+	}
+	
+	size_t count = 0;
+	
+	bool valid = ratatoskr::mmap_logging_engine::read(argv[1], [&](const ratatoskr::mmap_logging_engine::entry& entry) {
+		
+		auto since_epoch = entry.time.time_since_epoch();
+		
+		std::time_t time = std::chrono::system_clock::to_time_t(entry.time);
+		long milliseconds = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count() % 1000);
+		
+		struct tm local;
+		localtime_r(&time, &local);
+		
+		char stamp[32];
+		std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+		
+		// The level comes straight from the file
+		bool known = (entry.level >= ratatoskr::log_level::debug && entry.level <= ratatoskr::log_level::critical);
+		const char *level = known ? ratatoskr::logging_engine::translate_log_level(entry.level) : "(unknown)";
+		
+		std::printf("%s.%03ld %s %.*s\n", stamp, milliseconds, level, static_cast<int>(entry.length), entry.text);
+		count ++;
+	});
+	
+	if(!valid)
+	{
+		std::fprintf(stderr, "%s is not a ratatoskr ring file\n", argv[1]);
+		return 1;
+	}
+	
+	std::fprintf(stderr, "%zu messages\n", count);
+	return 0;
+}